@@ -0,0 +1,46 @@
+#pragma once
+#include <math.h>
+
+//A point or direction in the plane, for content that has no use for z
+struct Vec2 {
+	float x, y;
+	Vec2(float _x = 0, float _y = 0) : x(_x), y(_y) {}
+};
+
+//Affine transform of the plane as a 2x3 matrix, mapping (x, y) to
+//(a x + b y + tx, c x + d y + ty). Rotation about z, scaling and translation all
+//fit, and any chain of them composes into one, so a flat shape is moved with four
+//multiplies and four adds a point instead of a full 3D rotation.
+class Affine2 {
+public:
+	float a, b, tx;
+	float c, d, ty;
+	Affine2(float _a = 1, float _b = 0, float _tx = 0, float _c = 0, float _d = 1, float _ty = 0) : a(_a), b(_b), tx(_tx), c(_c), d(_d), ty(_ty) {}
+	static Affine2 translation(float dx, float dy) {
+		return Affine2(1, 0, dx, 0, 1, dy);
+	}
+	//Counter-clockwise by angle radians about pivot. The sine and cosine are taken once here, not per point.
+	static Affine2 rotation(float angle, const Vec2& pivot = Vec2()) {
+		float cosine = cosf(angle), sine = sinf(angle);
+		return Affine2(cosine, -sine, pivot.x - cosine * pivot.x + sine * pivot.y,
+			sine, cosine, pivot.y - sine * pivot.x - cosine * pivot.y);
+	}
+	static Affine2 scaling(float sx, float sy, const Vec2& pivot = Vec2()) {
+		return Affine2(sx, 0, pivot.x - sx * pivot.x, 0, sy, pivot.y - sy * pivot.y);
+	}
+	//This transform applied after other
+	Affine2 operator*(const Affine2& other) const {
+		return Affine2(a * other.a + b * other.c, a * other.b + b * other.d, a * other.tx + b * other.ty + tx,
+			c * other.a + d * other.c, c * other.b + d * other.d, c * other.tx + d * other.ty + ty);
+	}
+	Vec2 apply(float x, float y) const {
+		return Vec2(a * x + b * y + tx, c * x + d * y + ty);
+	}
+	//For directions, which only turn and stretch
+	Vec2 applyLinear(float x, float y) const {
+		return Vec2(a * x + b * y, c * x + d * y);
+	}
+	bool isTranslation() const {
+		return a == 1 && b == 0 && c == 0 && d == 1;
+	}
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+
+//Bump allocator for everything that lives as long as a scene. Memory comes from
+//a few large blocks and is handed back all at once with reset(), which keeps the
+//blocks so a refilled scene makes no further heap allocations.
+class Arena {
+	struct Block {
+		Block* next;
+		size_t size, used;
+		unsigned char* data() {
+			return (unsigned char*)(this + 1);
+		}
+	};
+	Block* head;
+	Block* current;
+	size_t blockSize;
+
+	Block* newBlock(size_t size) {
+		Block* block = (Block*)malloc(sizeof(Block) + size);
+		if (block == NULL)
+			throw std::bad_alloc();
+		block->next = NULL;
+		block->size = size;
+		block->used = 0;
+		return block;
+	}
+public:
+	Arena(size_t _blockSize = 1 << 20) {
+		head = current = NULL;
+		blockSize = _blockSize;
+	}
+	~Arena() {
+		while (head != NULL) {
+			Block* next = head->next;
+			free(head);
+			head = next;
+		}
+	}
+	void* allocate(size_t size, size_t align = alignof(max_align_t)) {
+		for (; current != NULL; current = current->next) {
+			//The address is aligned, not the offset: data follows a header that is not
+			//itself a multiple of every alignment
+			uintptr_t base = (uintptr_t)current->data();
+			size_t start = ((base + current->used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+			if (start + size <= current->size) {
+				current->used = start + size;
+				return current->data() + start;
+			}
+			if (current->next != NULL)
+				current->next->used = 0;
+		}
+		//Out of reserved blocks: append one large enough, growing the block size as we go
+		if (size + align > blockSize)
+			blockSize = size + align;
+		Block* block = newBlock(blockSize);
+		if (head == NULL)
+			head = block;
+		else {
+			Block* tail = head;
+			while (tail->next != NULL)
+				tail = tail->next;
+			tail->next = block;
+		}
+		current = block;
+		return allocate(size, align);
+	}
+	template<typename T>
+	T* allocateArray(int count) {
+		T* items = (T*)allocate(sizeof(T) * count, alignof(T));
+		for (int i = 0; i < count; i++)
+			new (&items[i]) T();
+		return items;
+	}
+	//Rewinds to empty without returning memory to the heap
+	void reset() {
+		current = head;
+		if (head != NULL)
+			head->used = 0;
+	}
+	size_t getReserved() {
+		size_t total = 0;
+		for (Block* block = head; block != NULL; block = block->next)
+			total += block->size;
+		return total;
+	}
+
+	//Arena that allocateArray() below draws from on this thread, or NULL for the heap
+	static Arena*& active() {
+		static thread_local Arena* arena = NULL;
+		return arena;
+	}
+};
+
+//Routes allocations made while it is alive into the given arena
+class ArenaScope {
+	Arena* previous;
+public:
+	ArenaScope(Arena& arena) {
+		previous = Arena::active();
+		Arena::active() = &arena;
+	}
+	~ArenaScope() {
+		Arena::active() = previous;
+	}
+};
+
+//new[] replacement for shape storage: uses the active arena if there is one.
+//fromArena records which, so freeArray() knows whether to give the memory back.
+template<typename T>
+T* allocateArray(int count, bool& fromArena) {
+	Arena* arena = Arena::active();
+	fromArena = arena != NULL;
+	if (fromArena)
+		return arena->allocateArray<T>(count);
+	return new T[count];
+}
+
+template<typename T>
+void freeArray(T* items, int count, bool fromArena) {
+	if (items == NULL)
+		return;
+	if (!fromArena)
+		delete[] items;
+	else {
+		for (int i = 0; i < count; i++)
+			items[i].~T();
+	}
+}
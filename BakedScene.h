@@ -0,0 +1,109 @@
+#pragma once
+#include "Shape.h"
+
+//The static picture drawn at startup, generated by the compiler. Triangles and
+//circles are laid out exactly as Triangle and Circle would build them, but into
+//one read-only vertex table, so startup only has to upload it.
+
+//One shape's slice of the baked vertex table
+struct BakedRange {
+	int first, count;
+	Vertex position;
+	constexpr BakedRange() : first(0), count(0), position() {}
+};
+
+template<int MaxVertices, int MaxRanges>
+struct BakedMesh {
+	Vertex vertices[MaxVertices];
+	BakedRange ranges[MaxRanges];
+	int vertexCount, rangeCount;
+
+	constexpr BakedMesh() : vertices(), ranges(), vertexCount(0), rangeCount(0) {}
+	constexpr void addRange(int count, const Vertex& position) {
+		ranges[rangeCount].first = vertexCount - count;
+		ranges[rangeCount].count = count;
+		ranges[rangeCount].position = position;
+		rangeCount++;
+	}
+	constexpr void addTriangle(const Vertex& a, const Vertex& b, const Vertex& c, const Vertex& position) {
+		vertices[vertexCount++] = a;
+		vertices[vertexCount++] = b;
+		vertices[vertexCount++] = c;
+		addRange(3, position);
+	}
+	struct CircleWriter {
+		Vertex* vertices;
+		double stepCos, stepSin;
+		float radius;
+		Vertex position;
+		constexpr void operator()(int j, float angle) const {
+			circleSegment(angle, stepCos, stepSin, radius, position, vertices + j);
+		}
+	};
+	//Walked and computed by the same code as Circle::Generate
+	constexpr void addCircle(float x, float y, float z, int segments, float radius, float scale) {
+		Vertex position(x, y, z);
+		int pointSize = segments * 3;
+		float step = 2 * PI * scale / segments;
+		CircleWriter writer = { vertices + vertexCount, bakedCos(step), bakedSin(step), radius, position };
+		walkCircle(pointSize, step, scale, writer);
+		vertexCount += pointSize;
+		addRange(pointSize, position);
+	}
+};
+
+const int BAKED_VERTEX_COUNT = 21 * 3 + 8 * 100 * 3;
+const int BAKED_SHAPE_COUNT = 29;
+
+constexpr BakedMesh<BAKED_VERTEX_COUNT, BAKED_SHAPE_COUNT> bakeStaticScene() {
+	BakedMesh<BAKED_VERTEX_COUNT, BAKED_SHAPE_COUNT> mesh;
+	const Vertex triangles[][3] =
+	{
+		{ Vertex(-0.45f, 0), Vertex(-0.085f, 0.25f), Vertex(0.25f, 0) },
+		{ Vertex(-0.45, 0), Vertex(0.25f, -0.45f), Vertex(0.25f, 0) },
+		{ Vertex(-0.45, 0), Vertex(-0.45f, -0.45f), Vertex(0.25f, -0.45f) },
+		{ Vertex(0, -0.45f), Vertex(0.15f, -0.25f), Vertex(0.15f, -0.45f) },
+		{ Vertex(0, -0.45f), Vertex(0, -0.25f), Vertex(0.15f, -0.25f) },
+		{ Vertex(-0.65f , -0.45f), Vertex(-0.75f , -0.1f), Vertex(-0.85f, -0.45f) },
+		{ Vertex(-0.35f , -0.15f), Vertex(-0.25f , -0.05f), Vertex(-0.15f, -0.15f) },
+		{ Vertex(-0.35f , -0.15f), Vertex(-0.25f , -0.25f), Vertex(-0.15f, -0.15f) },
+		{ Vertex(-0.95f , -0.25f), Vertex(-0.75f , -0.1f), Vertex(-0.55f, -0.25f) },
+		{ Vertex(-0.95f , -0.15f), Vertex(-0.75f , 0), Vertex(-0.55f, -0.15f) },
+		{ Vertex(-0.87f , -0.05f), Vertex(-0.75f , 0.15f), Vertex(-0.65f, -0.05f) },
+		{ Vertex(-1 , -0.45f), Vertex(-1 , -0.75f), Vertex(1 , -0.45f) },
+		{ Vertex(1 , -0.45f), Vertex(1 , -0.75f), Vertex(-1 , -0.75f) },
+		{ Vertex(0.27f , -0.35f), Vertex(0.27f, -0.2f), Vertex(0.67f , -0.35f) },
+		{ Vertex(0.67f , -0.35f), Vertex(0.27f , -0.2f), Vertex(0.67f , -0.2f) },
+		{ Vertex(0.35f , -0.2f), Vertex(0.51f , -0.2f), Vertex(0.37f , -0.05f) },
+		{ Vertex(0.37f , -0.05f), Vertex(0.51f , -0.2f), Vertex(0.55f , -0.05f) },
+		{ Vertex(0.55f , -0.05f), Vertex(0.51f , -0.2f), Vertex(0.6f, -0.2f) },
+		{ Vertex(0.75f , -0.02f), Vertex(0.75f , -0.45f), Vertex(0.78f , -0.02f) },
+		{ Vertex(0.75f , -0.45f), Vertex(0.78f , -0.02f), Vertex(0.78f , -0.45f) },
+		{ Vertex(0.75f , -0.12f), Vertex(0.765f , -0.02f), Vertex(0.78f , -0.12f) }
+	};
+	const Vertex trianglePosition(0.5f, 0.5f);
+
+	for (int i = 0; i < 15; i++)
+		mesh.addTriangle(triangles[i][0], triangles[i][1], triangles[i][2], trianglePosition);
+
+	mesh.addCircle(0.65, -0.275, 0, 100, 0.077, 1);
+	mesh.addCircle(0.35, -0.376, 0, 100, 0.077, 1);
+	mesh.addCircle(0.6, -0.376, 0, 100, 0.077, 1);
+	mesh.addCircle(0.6, -0.376, 0, 100, 0.04, 1);
+	mesh.addCircle(0.35, -0.376, 0, 100, 0.04, 1);
+
+	for (int i = 15; i < 20; i++)
+		mesh.addTriangle(triangles[i][0], triangles[i][1], triangles[i][2], trianglePosition);
+
+	mesh.addCircle(0.765, -0.02, 0, 100, 0.1, 1);
+	mesh.addTriangle(triangles[20][0], triangles[20][1], triangles[20][2], trianglePosition);
+
+	mesh.addCircle(0, 0.7, 0, 100, 0.17, 1);
+	mesh.addCircle(-0.1, 0.7, 0, 100, 0.17, 1);
+	return mesh;
+}
+
+constexpr BakedMesh<BAKED_VERTEX_COUNT, BAKED_SHAPE_COUNT> STATIC_SCENE = bakeStaticScene();
+
+static_assert(STATIC_SCENE.vertexCount == BAKED_VERTEX_COUNT, "static scene vertex table is not full");
+static_assert(STATIC_SCENE.rangeCount == BAKED_SHAPE_COUNT, "static scene shape count changed");
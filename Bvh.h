@@ -0,0 +1,352 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "Shape.h"
+
+//Bounding volume hierarchy over the boxes in a BoundsList, for point, rectangle
+//and ray queries that only visit the part of the scene they touch. The tree is
+//built with a binned surface area heuristic and afterwards refit in place as
+//shapes move, walking up from each changed leaf only. Boxes added after the last
+//build are scanned directly until there are enough of them to be worth a rebuild.
+class Bvh {
+	struct Node {
+		float lowerX, lowerY, upperX, upperY;
+		int first; //leaves: first entry in items, internal nodes: left child (right is first + 1)
+		int count; //0 for internal nodes
+	};
+	//A box copied out of the list for building, kept next to its center so the
+	//build walks memory in order as it partitions
+	struct BuildItem {
+		float lowerX, lowerY, upperX, upperY;
+		float centerX, centerY;
+		int slot;
+	};
+	static const int BINS = 16;
+	static const int MAX_LEAF_SIZE = 4;
+	static const int MAX_DEPTH = 60;
+	static const int STACK_SIZE = MAX_DEPTH + 2;
+
+	const BoundsList* list;
+	std::vector<Node> nodes;
+	std::vector<int> parents;
+	std::vector<int> items; //slots in list, grouped by leaf
+	std::vector<int> leafOf; //slot -> leaf node
+	std::vector<BuildItem> building;
+	std::vector<int> changed;
+	int indexedCount, depth;
+
+	//Half the perimeter: how likely a box is to be crossed, in 2D
+	static float cost(float lowerX, float lowerY, float upperX, float upperY) {
+		return lowerX > upperX ? 0 : (upperX - lowerX) + (upperY - lowerY);
+	}
+	static void include(Node& node, float lowerX, float lowerY, float upperX, float upperY) {
+		node.lowerX = lowerX < node.lowerX ? lowerX : node.lowerX;
+		node.lowerY = lowerY < node.lowerY ? lowerY : node.lowerY;
+		node.upperX = upperX > node.upperX ? upperX : node.upperX;
+		node.upperY = upperY > node.upperY ? upperY : node.upperY;
+	}
+	static void include(Node& node, const Bounds& bounds) {
+		include(node, bounds.lower.x, bounds.lower.y, bounds.upper.x, bounds.upper.y);
+	}
+	static void makeEmpty(Node& node) {
+		node.lowerX = node.lowerY = FLT_MAX;
+		node.upperX = node.upperY = -FLT_MAX;
+	}
+	static bool sameBounds(const Node& a, const Node& b) {
+		return a.lowerX == b.lowerX && a.lowerY == b.lowerY && a.upperX == b.upperX && a.upperY == b.upperY;
+	}
+	int addNode(int parent) {
+		Node node;
+		makeEmpty(node);
+		node.first = node.count = 0;
+		nodes.push_back(node);
+		parents.push_back(parent);
+		return nodes.size() - 1;
+	}
+	void makeLeaf(int index, int first, int count) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		for (int i = first; i < first + count; i++) {
+			items[i] = building[i].slot;
+			leafOf[items[i]] = index;
+		}
+	}
+	void subdivide(int index, int first, int count, int level) {
+		Node centers;
+		makeEmpty(centers);
+		makeEmpty(nodes[index]);
+		for (int i = first; i < first + count; i++) {
+			const BuildItem& item = building[i];
+			include(nodes[index], item.lowerX, item.lowerY, item.upperX, item.upperY);
+			include(centers, item.centerX, item.centerY, item.centerX, item.centerY);
+		}
+		depth = level > depth ? level : depth;
+		if (count <= MAX_LEAF_SIZE || level >= MAX_DEPTH) {
+			makeLeaf(index, first, count);
+			return;
+		}
+
+		//Split along the axis the centers spread furthest on
+		bool alongX = centers.upperX - centers.lowerX >= centers.upperY - centers.lowerY;
+		float lower = alongX ? centers.lowerX : centers.lowerY;
+		float extent = alongX ? centers.upperX - centers.lowerX : centers.upperY - centers.lowerY;
+		//With every center in one place there is nothing to cut; halve the range so leaves stay small
+		int middle = first + count / 2;
+		if (extent > 0) {
+			Node bins[BINS];
+			int binCounts[BINS] = {};
+			for (int b = 0; b < BINS; b++)
+				makeEmpty(bins[b]);
+			float scale = BINS / extent;
+			auto binOf = [&](const BuildItem& item) {
+				int b = (int)(((alongX ? item.centerX : item.centerY) - lower) * scale);
+				return b < BINS ? b : BINS - 1;
+			};
+			for (int i = first; i < first + count; i++) {
+				int b = binOf(building[i]);
+				binCounts[b]++;
+				include(bins[b], building[i].lowerX, building[i].lowerY, building[i].upperX, building[i].upperY);
+			}
+			//Sweep from the right to price every right half, then from the left to find the cheapest cut
+			float rightCost[BINS];
+			Node right;
+			makeEmpty(right);
+			int rightCount = 0;
+			for (int b = BINS - 1; b > 0; b--) {
+				include(right, bins[b].lowerX, bins[b].lowerY, bins[b].upperX, bins[b].upperY);
+				rightCount += binCounts[b];
+				rightCost[b] = rightCount * cost(right.lowerX, right.lowerY, right.upperX, right.upperY);
+			}
+			Node left;
+			makeEmpty(left);
+			int leftCount = 0, bestBin = -1;
+			float bestCost = FLT_MAX;
+			for (int b = 0; b < BINS - 1; b++) {
+				include(left, bins[b].lowerX, bins[b].lowerY, bins[b].upperX, bins[b].upperY);
+				leftCount += binCounts[b];
+				float split = leftCount * cost(left.lowerX, left.lowerY, left.upperX, left.upperY) + rightCost[b + 1];
+				if (leftCount > 0 && leftCount < count && split < bestCost) {
+					bestCost = split;
+					bestBin = b;
+				}
+			}
+			if (bestBin >= 0) {
+				BuildItem* split = std::partition(&building[first], &building[first] + count, [&](const BuildItem& item) {
+					return binOf(item) <= bestBin;
+				});
+				middle = split - &building[0];
+			}
+		}
+		int leftChild = addNode(index);
+		addNode(index);
+		nodes[index].first = leftChild;
+		nodes[index].count = 0;
+		subdivide(leftChild, first, middle - first, level + 1);
+		subdivide(leftChild + 1, middle, first + count - middle, level + 1);
+	}
+	void refitLeaf(int index) {
+		Node& node = nodes[index];
+		makeEmpty(node);
+		for (int i = node.first; i < node.first + node.count; i++)
+			include(node, list->get(items[i]));
+	}
+	void refitInternal(int index) {
+		Node& node = nodes[index];
+		const Node& left = nodes[node.first];
+		const Node& right = nodes[node.first + 1];
+		makeEmpty(node);
+		include(node, left.lowerX, left.lowerY, left.upperX, left.upperY);
+		include(node, right.lowerX, right.lowerY, right.upperX, right.upperY);
+	}
+	//Recomputes a leaf and its ancestors, stopping once a node comes out unchanged
+	void refitUpward(int index) {
+		Node before = nodes[index];
+		refitLeaf(index);
+		while (!sameBounds(before, nodes[index]) && parents[index] >= 0) {
+			index = parents[index];
+			before = nodes[index];
+			refitInternal(index);
+		}
+	}
+	static bool nodeContains(const Node& node, float x, float y) {
+		return x >= node.lowerX && x <= node.upperX && y >= node.lowerY && y <= node.upperY;
+	}
+	static bool nodeOverlaps(const Node& node, const Bounds& rect) {
+		return node.lowerX <= rect.upper.x && node.upperX >= rect.lower.x && node.lowerY <= rect.upper.y && node.upperY >= rect.lower.y;
+	}
+	//Narrows [enter, exit] to where the ray is between lower and upper on one axis.
+	//A ray parallel to the axis is between them for every t or for none; that case is
+	//taken apart, as 0 times an infinite inverse would make the bounds NaN.
+	static void clipSlab(float lower, float upper, float origin, float direction, float inverse, float& enter, float& exit) {
+		if (direction == 0) {
+			if (origin < lower || origin > upper)
+				exit = -FLT_MAX;
+			return;
+		}
+		float t1 = (lower - origin) * inverse, t2 = (upper - origin) * inverse;
+		enter = std::max(enter, std::min(t1, t2));
+		exit = std::min(exit, std::max(t1, t2));
+	}
+	//Slab test of the ray against a box, within [0, length]
+	static bool rayHits(float lowerX, float lowerY, float upperX, float upperY, const Vertex& origin, const Vertex& direction, const Vertex& inverse, float length) {
+		float enter = 0, exit = length;
+		clipSlab(lowerX, upperX, origin.x, direction.x, inverse.x, enter, exit);
+		clipSlab(lowerY, upperY, origin.y, direction.y, inverse.y, enter, exit);
+		return lowerX <= upperX && enter <= exit;
+	}
+public:
+	Bvh() {
+		list = NULL;
+		indexedCount = 0;
+		depth = 0;
+	}
+	void clear() {
+		list = NULL;
+		nodes.clear();
+		parents.clear();
+		items.clear();
+		leafOf.clear();
+		indexedCount = 0;
+		depth = 0;
+	}
+	//Rebuilds the whole tree over every slot in _list
+	void build(const BoundsList& _list) {
+		clear();
+		list = &_list;
+		indexedCount = list->size();
+		if (indexedCount == 0)
+			return;
+		items.resize(indexedCount);
+		leafOf.resize(indexedCount);
+		building.resize(indexedCount);
+		for (int i = 0; i < indexedCount; i++) {
+			Bounds bounds = list->get(i);
+			BuildItem& item = building[i];
+			item.lowerX = bounds.lower.x;
+			item.lowerY = bounds.lower.y;
+			item.upperX = bounds.upper.x;
+			item.upperY = bounds.upper.y;
+			item.centerX = bounds.isEmpty() ? 0 : (bounds.lower.x + bounds.upper.x) * 0.5f;
+			item.centerY = bounds.isEmpty() ? 0 : (bounds.lower.y + bounds.upper.y) * 0.5f;
+			item.slot = i;
+		}
+		nodes.reserve(2 * indexedCount / MAX_LEAF_SIZE + 1);
+		parents.reserve(nodes.capacity());
+		addNode(-1);
+		subdivide(0, 0, indexedCount, 0);
+		std::vector<BuildItem>().swap(building);
+	}
+	//Catches the tree up with _list: refits what moved, and rebuilds when the list
+	//was cleared or a quarter more boxes arrived since the last build
+	void update(BoundsList& _list) {
+		int size = _list.size();
+		if (list != &_list || size < indexedCount || size - indexedCount > std::max(256, indexedCount / 4)) {
+			_list.takeChanged(changed);
+			build(_list);
+			return;
+		}
+		_list.takeChanged(changed);
+		if (indexedCount == 0 || changed.empty())
+			return;
+		if ((int)changed.size() > indexedCount / 8) {
+			//Children always come after their parent, so one backwards pass refits everything
+			for (int i = nodes.size() - 1; i >= 0; i--) {
+				if (nodes[i].count > 0)
+					refitLeaf(i);
+				else
+					refitInternal(i);
+			}
+			return;
+		}
+		for (int i = 0; i < changed.size(); i++)
+			if (changed[i] < indexedCount)
+				refitUpward(leafOf[changed[i]]);
+	}
+	//Appends every slot whose box contains the point
+	void queryPoint(float x, float y, std::vector<int>& found) const {
+		if (indexedCount > 0) {
+			int stack[STACK_SIZE];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				const Node& node = nodes[stack[--top]];
+				if (!nodeContains(node, x, y))
+					continue;
+				if (node.count == 0) {
+					stack[top++] = node.first;
+					stack[top++] = node.first + 1;
+					continue;
+				}
+				for (int i = node.first; i < node.first + node.count; i++)
+					if (list->contains(items[i], x, y))
+						found.push_back(items[i]);
+			}
+		}
+		for (int i = indexedCount; list != NULL && i < list->size(); i++)
+			if (list->contains(i, x, y))
+				found.push_back(i);
+	}
+	//Appends every slot whose box overlaps rect in x and y
+	void queryRect(const Bounds& rect, std::vector<int>& found) const {
+		if (indexedCount > 0) {
+			int stack[STACK_SIZE];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				const Node& node = nodes[stack[--top]];
+				if (!nodeOverlaps(node, rect))
+					continue;
+				if (node.count == 0) {
+					stack[top++] = node.first;
+					stack[top++] = node.first + 1;
+					continue;
+				}
+				for (int i = node.first; i < node.first + node.count; i++)
+					if (list->overlaps(items[i], rect))
+						found.push_back(items[i]);
+			}
+		}
+		for (int i = indexedCount; list != NULL && i < list->size(); i++)
+			if (list->overlaps(i, rect))
+				found.push_back(i);
+	}
+	//Appends every slot whose box the ray from origin along direction crosses within
+	//length, measured in multiples of direction. Only x and y are used.
+	void queryRay(const Vertex& origin, const Vertex& direction, float length, std::vector<int>& found) const {
+		Vertex inverse(1.0f / direction.x, 1.0f / direction.y);
+		if (indexedCount > 0) {
+			int stack[STACK_SIZE];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				const Node& node = nodes[stack[--top]];
+				if (!rayHits(node.lowerX, node.lowerY, node.upperX, node.upperY, origin, direction, inverse, length))
+					continue;
+				if (node.count == 0) {
+					stack[top++] = node.first;
+					stack[top++] = node.first + 1;
+					continue;
+				}
+				for (int i = node.first; i < node.first + node.count; i++) {
+					Bounds bounds = list->get(items[i]);
+					if (rayHits(bounds.lower.x, bounds.lower.y, bounds.upper.x, bounds.upper.y, origin, direction, inverse, length))
+						found.push_back(items[i]);
+				}
+			}
+		}
+		for (int i = indexedCount; list != NULL && i < list->size(); i++) {
+			Bounds bounds = list->get(i);
+			if (rayHits(bounds.lower.x, bounds.lower.y, bounds.upper.x, bounds.upper.y, origin, direction, inverse, length))
+				found.push_back(i);
+		}
+	}
+	int getNodeCount() {
+		return nodes.size();
+	}
+	int getDepth() {
+		return depth;
+	}
+	int getIndexedCount() {
+		return indexedCount;
+	}
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <glew.h>
+#include <vector>
+#include "Shader.h"
+#include "GLHandle.h"
+#include "StencilFill.h"
+#include "VertexFormat.h"
+
+enum class CommandType : uint8_t { Clear, Allocate, Upload, Draw };
+
+//One recorded GL call. Buffers are named either directly by their GL name, for
+//buffers made on the GL thread, or by a slot the replaying side creates on first
+//use, for geometry that appears while recording, such as a new stroke. Kept small
+//since a large scene records hundreds of thousands of these a frame.
+struct Command {
+	CommandType type;
+	bool replace; //Upload: respecify the whole buffer rather than overwrite part of it
+	FillRule fill; //Draw: anything but Triangles fills count outline points through the stencil
+	VertexFormat format; //Upload, Draw: how the buffer's points are laid out
+	GLuint buffer;
+	int slot; //-1 when buffer is used
+	union {
+		struct {
+			GLuint program; //as recorded; placeholders are resolved at replay
+			GLuint indexBuffer; //0 to draw the vertices in order
+			GLenum mode;
+			GLsizei count;
+		} draw;
+		struct {
+			uint32_t offset, size; //bytes into the buffer, and how many
+			uint32_t data; //where the bytes start in the list's payload
+		} upload; //also Allocate, which only uses size
+		GLbitfield mask; //Clear
+	};
+};
+
+//GL work written down on one thread to be issued on another. Recording touches
+//no GL state, and vertex data is copied into the list, so the recording thread
+//may keep changing the scene while the GL thread replays an earlier list.
+class CommandList {
+	std::vector<Command> commands;
+	std::vector<unsigned char> payload;
+
+	Command& add(CommandType type) {
+		commands.resize(commands.size() + 1);
+		Command& command = commands.back();
+		command.type = type;
+		command.replace = false;
+		command.fill = FillRule::Triangles;
+		command.format = VertexFormat::Float3;
+		command.buffer = 0;
+		command.slot = -1;
+		return command;
+	}
+	static GLuint resolveBuffer(const Command& command, std::vector<GLBuffer>& slots) {
+		if (command.slot < 0)
+			return command.buffer;
+		if (command.slot >= (int)slots.size())
+			slots.resize(command.slot + 1);
+		if (slots[command.slot].get() == 0)
+			slots[command.slot] = GLBuffer::create();
+		return slots[command.slot].get();
+	}
+public:
+	//Keeps the storage, so a list recorded every frame stops allocating once warm
+	void reset() {
+		commands.clear();
+		payload.clear();
+	}
+	int getCommandCount() {
+		return commands.size();
+	}
+	size_t getPayloadBytes() {
+		return payload.size();
+	}
+	void clear(GLbitfield mask) {
+		add(CommandType::Clear).mask = mask;
+	}
+	//Gives a slot buffer size bytes of undefined contents
+	void allocate(int slot, size_t size) {
+		Command& command = add(CommandType::Allocate);
+		command.slot = slot;
+		command.upload.size = size;
+	}
+	void upload(GLuint buffer, int slot, size_t offset, const void* data, size_t size, bool replace, VertexFormat format = VertexFormat::Float3) {
+		Command& command = add(CommandType::Upload);
+		command.format = format;
+		command.buffer = buffer;
+		command.slot = slot;
+		command.upload.offset = offset;
+		command.upload.size = size;
+		command.upload.data = payload.size();
+		command.replace = replace;
+		payload.resize(payload.size() + size);
+		if (size > 0)
+			memcpy(&payload[command.upload.data], data, size);
+	}
+	void draw(GLuint program, GLuint buffer, int slot, GLuint indexBuffer, GLenum mode, GLsizei count, VertexFormat format = VertexFormat::Float3) {
+		Command& command = add(CommandType::Draw);
+		command.format = format;
+		command.buffer = buffer;
+		command.slot = slot;
+		command.draw.program = program;
+		command.draw.indexBuffer = indexBuffer;
+		command.draw.mode = mode;
+		command.draw.count = count;
+	}
+	//Fills the outline in the buffer's first outlineCount points, followed by its cover quad
+	void fill(GLuint program, GLuint buffer, int slot, FillRule rule, GLsizei outlineCount, VertexFormat format = VertexFormat::Float3) {
+		draw(program, buffer, slot, 0, GL_TRIANGLE_FAN, outlineCount, format);
+		commands.back().fill = rule;
+	}
+	//Issues everything in order on the GL thread. Program and buffer bindings are
+	//only changed when a draw needs different ones.
+	void replay(std::vector<GLBuffer>& slots) {
+		GLuint boundProgram = 0, boundBuffer = 0;
+		for (size_t i = 0; i < commands.size(); i++) {
+			const Command& command = commands[i];
+			switch (command.type) {
+			case CommandType::Clear:
+				if (command.mask & GL_STENCIL_BUFFER_BIT)
+					glStencilMask(0xFF);
+				glClear(command.mask);
+				break;
+			case CommandType::Allocate:
+				boundBuffer = resolveBuffer(command, slots);
+				glBindBuffer(GL_ARRAY_BUFFER, boundBuffer);
+				glBufferData(GL_ARRAY_BUFFER, command.upload.size, NULL, GL_DYNAMIC_DRAW);
+				setVertexAttribute(command.format);
+				break;
+			case CommandType::Upload:
+				boundBuffer = resolveBuffer(command, slots);
+				glBindBuffer(GL_ARRAY_BUFFER, boundBuffer);
+				if (command.replace)
+					glBufferData(GL_ARRAY_BUFFER, command.upload.size, command.upload.size > 0 ? &payload[command.upload.data] : NULL, GL_STATIC_DRAW);
+				else
+					glBufferSubData(GL_ARRAY_BUFFER, command.upload.offset, command.upload.size, &payload[command.upload.data]);
+				setVertexAttribute(command.format);
+				break;
+			case CommandType::Draw: {
+				GLuint program = resolveProgram(command.draw.program);
+				if (program != boundProgram) {
+					glUseProgram(program);
+					boundProgram = program;
+				}
+				GLuint buffer = resolveBuffer(command, slots);
+				if (buffer != boundBuffer) {
+					glBindBuffer(GL_ARRAY_BUFFER, buffer);
+					setVertexAttribute(command.format);
+					boundBuffer = buffer;
+				}
+				if (command.fill != FillRule::Triangles)
+					drawStencilFill(command.fill, command.draw.count);
+				else if (command.draw.indexBuffer != 0) {
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, command.draw.indexBuffer);
+					glDrawElements(command.draw.mode, command.draw.count, GL_UNSIGNED_INT, 0);
+				}
+				else
+					glDrawArrays(command.draw.mode, 0, command.draw.count);
+				break;
+			}
+			}
+		}
+	}
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <math.h>
+#include <vector>
+#include "Shape.h"
+#include "GLHandle.h"
+#include "Logger.h"
+
+//Parts of the window that changed since the last frame, in the same coordinates
+//as the points. Overlapping rectangles are merged as they arrive and past a few
+//everything collapses into one, so a redraw only covers what actually changed.
+class DamageTracker {
+	static const int MAX_RECTS = 8;
+	std::vector<Bounds> rects;
+	bool everything;
+public:
+	DamageTracker() {
+		everything = false;
+	}
+	void add(Bounds rect) {
+		if (everything || rect.isEmpty())
+			return;
+		//Absorbing one rectangle can make the result overlap another, so go round until none do
+		for (size_t i = 0; i < rects.size();) {
+			if (rects[i].overlaps(rect)) {
+				rect.expand(rects[i]);
+				rects.erase(rects.begin() + i);
+				i = 0;
+			}
+			else
+				i++;
+		}
+		rects.push_back(rect);
+		if (rects.size() > MAX_RECTS) {
+			for (size_t i = 1; i < rects.size(); i++)
+				rects[0].expand(rects[i]);
+			rects.resize(1);
+		}
+	}
+	void addAll() {
+		everything = true;
+		rects.clear();
+	}
+	bool isEmpty() {
+		return !everything && rects.empty();
+	}
+	bool isEverything() {
+		return everything;
+	}
+	const std::vector<Bounds>& getRects() {
+		return rects;
+	}
+	void clear() {
+		everything = false;
+		rects.clear();
+	}
+};
+
+//Offscreen copy of the window whose contents survive from one frame to the next,
+//unlike the back buffer after a swap. Only damaged parts are drawn into it, and
+//each presented frame copies the whole of it to the window.
+class RetainedFrame {
+	GLFramebuffer framebuffer;
+	GLRenderbuffer color, depthStencil;
+	int width, height;
+public:
+	RetainedFrame() {
+		width = height = 0;
+	}
+	bool isValid() {
+		return framebuffer.get() != 0;
+	}
+	bool hasSize(int _width, int _height) {
+		return width == _width && height == _height;
+	}
+	//Matches the window's size and sample count, since blitting between them requires both
+	bool resize(int _width, int _height) {
+		width = _width;
+		height = _height;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLint samples = 0;
+		glGetIntegerv(GL_SAMPLES, &samples);
+		color = GLRenderbuffer::create();
+		glBindRenderbuffer(GL_RENDERBUFFER, color.get());
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+		//Stencil-filled outlines need a stencil buffer here as much as in the window
+		depthStencil = GLRenderbuffer::create();
+		glBindRenderbuffer(GL_RENDERBUFFER, depthStencil.get());
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+		framebuffer = GLFramebuffer::create();
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color.get());
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil.get());
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (!complete) {
+			LOG_WARN(LogCategory::Render, "Retained frame unavailable, redrawing the whole window on every change");
+			framebuffer.reset();
+			color.reset();
+			depthStencil.reset();
+		}
+		return complete;
+	}
+	void bind() {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+	}
+	//Copies the retained frame to the window's back buffer and leaves the window bound
+	void present() {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.get());
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+};
+
+//Pixel rectangle covering rect on a width x height window, grown by margin pixels
+//so antialiased edges are redrawn too. rect is turned into the area actually covered.
+inline void damageToPixels(Bounds& rect, int width, int height, int margin, GLint& x, GLint& y, GLsizei& w, GLsizei& h) {
+	int x0 = (int)floorf((rect.lower.x + 1) * 0.5f * width) - margin;
+	int y0 = (int)floorf((rect.lower.y + 1) * 0.5f * height) - margin;
+	int x1 = (int)ceilf((rect.upper.x + 1) * 0.5f * width) + margin;
+	int y1 = (int)ceilf((rect.upper.y + 1) * 0.5f * height) + margin;
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 > width ? width : x1;
+	y1 = y1 > height ? height : y1;
+	x = x0;
+	y = y0;
+	w = x1 > x0 ? x1 - x0 : 0;
+	h = y1 > y0 ? y1 - y0 : 0;
+	rect.lower = Vertex(x0 * 2.0f / width - 1, y0 * 2.0f / height - 1, -1);
+	rect.upper = Vertex(x1 * 2.0f / width - 1, y1 * 2.0f / height - 1, 1);
+}
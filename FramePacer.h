@@ -0,0 +1,143 @@
+#pragma once
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+enum class PacingMode {
+	Vsync, //swap waits for the display, one frame per refresh
+	Uncapped, //swap returns at once, as many frames as the GPU can take
+	Fixed //swap returns at once and the pacer holds each frame to a set rate
+};
+
+//Frame times collected over a run, for the mean, spread and worst cases.
+class FrameStats {
+	std::vector<double> times; //seconds
+	double total, totalSquares;
+public:
+	FrameStats() {
+		clear();
+	}
+	void clear() {
+		times.clear();
+		total = totalSquares = 0;
+	}
+	void add(double seconds) {
+		times.push_back(seconds);
+		total += seconds;
+		totalSquares += seconds * seconds;
+	}
+	int getCount() {
+		return times.size();
+	}
+	double getTotal() {
+		return total;
+	}
+	double getMean() {
+		return times.empty() ? 0 : total / times.size();
+	}
+	double getStdDev() {
+		if (times.size() < 2)
+			return 0;
+		double mean = getMean();
+		double variance = totalSquares / times.size() - mean * mean;
+		return variance > 0 ? sqrt(variance) : 0;
+	}
+	double getMin() {
+		return times.empty() ? 0 : *std::min_element(times.begin(), times.end());
+	}
+	double getMax() {
+		return times.empty() ? 0 : *std::max_element(times.begin(), times.end());
+	}
+	//fraction 0.99 gives the time 99% of frames came in under
+	double getPercentile(double fraction) {
+		if (times.empty())
+			return 0;
+		std::vector<double> sorted(times);
+		size_t rank = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+		return sorted[rank];
+	}
+};
+
+//Holds the render loop to the chosen pacing. In Fixed mode wait() sleeps for
+//most of the time left in the frame and spins through the rest, because sleeps
+//wake late by up to a scheduler tick. How late they wake is measured as it goes,
+//so the spin stays short where the OS timer is fine and long where it is coarse.
+class FramePacer {
+	typedef std::chrono::steady_clock Clock;
+	PacingMode mode;
+	double rate;
+	Clock::duration period, spinMargin;
+	Clock::time_point deadline;
+public:
+	FramePacer() {
+		mode = PacingMode::Vsync;
+		rate = 0;
+		period = Clock::duration::zero();
+		spinMargin = std::chrono::milliseconds(2);
+	}
+	void setMode(PacingMode _mode, double _rate = 0) {
+		mode = _rate > 0 || _mode != PacingMode::Fixed ? _mode : PacingMode::Uncapped;
+		rate = mode == PacingMode::Fixed ? _rate : 0;
+		period = mode == PacingMode::Fixed ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate)) : Clock::duration::zero();
+		deadline = Clock::now();
+	}
+	//vsync, uncapped, or a rate in Hz such as 60
+	bool parse(const char* text) {
+		if (strcmp(text, "vsync") == 0)
+			setMode(PacingMode::Vsync);
+		else if (strcmp(text, "uncapped") == 0 || strcmp(text, "off") == 0)
+			setMode(PacingMode::Uncapped);
+		else if (atof(text) > 0)
+			setMode(PacingMode::Fixed, atof(text));
+		else
+			return false;
+		return true;
+	}
+	PacingMode getMode() {
+		return mode;
+	}
+	double getRate() {
+		return rate;
+	}
+	//For glfwSwapInterval; only vsync lets the swap itself wait
+	int getSwapInterval() {
+		return mode == PacingMode::Vsync ? 1 : 0;
+	}
+	const char* describe(char* text, size_t size) {
+		if (mode == PacingMode::Fixed)
+			snprintf(text, size, "%g Hz", rate);
+		else
+			snprintf(text, size, "%s", mode == PacingMode::Vsync ? "vsync" : "uncapped");
+		return text;
+	}
+	//Call once per frame. Returns at once unless the pacing is Fixed.
+	void wait() {
+		if (mode != PacingMode::Fixed)
+			return;
+		Clock::time_point now = Clock::now();
+		if (now >= deadline) {
+			//A slightly late frame keeps the schedule; one that missed a whole period starts a new one instead of rushing to catch up
+			deadline = now - deadline < period ? deadline + period : now + period;
+			return;
+		}
+		if (deadline - now > spinMargin) {
+			Clock::time_point wake = deadline - spinMargin;
+			std::this_thread::sleep_until(wake);
+			Clock::duration late = Clock::now() - wake;
+			//Grow at once to cover a late wake, shrink slowly when wakes are prompt
+			if (late > spinMargin)
+				spinMargin = std::min(late + late / 4, period);
+			else
+				spinMargin = std::max(spinMargin - (spinMargin - late) / 16, Clock::duration(std::chrono::microseconds(200)));
+		}
+		while (Clock::now() < deadline)
+			;
+		deadline += period;
+	}
+};
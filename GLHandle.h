@@ -0,0 +1,104 @@
+#pragma once
+#include <glew.h>
+
+struct GLBufferTraits {
+	static GLuint create() {
+		GLuint id = 0;
+		glGenBuffers(1, &id);
+		return id;
+	}
+	static void destroy(GLuint id) {
+		glDeleteBuffers(1, &id);
+	}
+};
+
+struct GLProgramTraits {
+	static GLuint create() {
+		return glCreateProgram();
+	}
+	static void destroy(GLuint id) {
+		glDeleteProgram(id);
+	}
+};
+
+struct GLVertexArrayTraits {
+	static GLuint create() {
+		GLuint id = 0;
+		glGenVertexArrays(1, &id);
+		return id;
+	}
+	static void destroy(GLuint id) {
+		glDeleteVertexArrays(1, &id);
+	}
+};
+
+struct GLFramebufferTraits {
+	static GLuint create() {
+		GLuint id = 0;
+		glGenFramebuffers(1, &id);
+		return id;
+	}
+	static void destroy(GLuint id) {
+		glDeleteFramebuffers(1, &id);
+	}
+};
+
+struct GLRenderbufferTraits {
+	static GLuint create() {
+		GLuint id = 0;
+		glGenRenderbuffers(1, &id);
+		return id;
+	}
+	static void destroy(GLuint id) {
+		glDeleteRenderbuffers(1, &id);
+	}
+};
+
+//Owns one GL object name and deletes it when it goes out of scope. Handles can
+//be moved but not copied, so there is always exactly one owner per object.
+template<typename Traits>
+class GLHandle {
+	GLuint id;
+public:
+	GLHandle() : id(0) {}
+	explicit GLHandle(GLuint _id) : id(_id) {}
+	GLHandle(const GLHandle&) = delete;
+	GLHandle& operator=(const GLHandle&) = delete;
+	GLHandle(GLHandle&& other) noexcept : id(other.id) {
+		other.id = 0;
+	}
+	GLHandle& operator=(GLHandle&& other) noexcept {
+		if (this != &other) {
+			reset(other.id);
+			other.id = 0;
+		}
+		return *this;
+	}
+	~GLHandle() {
+		reset();
+	}
+	static GLHandle create() {
+		return GLHandle(Traits::create());
+	}
+	GLuint get() const {
+		return id;
+	}
+	//Deletes the current object, if any, and takes ownership of another
+	void reset(GLuint _id = 0) {
+		if (id != 0)
+			Traits::destroy(id);
+		id = _id;
+	}
+	//Gives up ownership without deleting
+	GLuint release() {
+		GLuint released = id;
+		id = 0;
+		return released;
+	}
+};
+
+typedef GLHandle<GLBufferTraits> GLBuffer;
+typedef GLHandle<GLProgramTraits> GLProgram;
+typedef GLHandle<GLVertexArrayTraits> GLVertexArray;
+typedef GLHandle<GLFramebufferTraits> GLFramebuffer;
+typedef GLHandle<GLRenderbufferTraits> GLRenderbuffer;
@@ -0,0 +1,82 @@
+#pragma once
+#include <math.h>
+#include <vector>
+#include "Shape.h"
+#include "SpscQueue.h"
+
+enum class InputEventType { Move, Press, Release };
+
+//Cursor positions are already converted to normalized device coordinates
+struct InputEvent {
+	InputEventType type;
+	int button;
+	int mods; //GLFW_MOD_* held when a button changed
+	float x, y;
+	InputEvent(InputEventType _type = InputEventType::Move, float _x = 0, float _y = 0, int _button = -1, int _mods = 0) {
+		type = _type;
+		x = _x;
+		y = _y;
+		button = _button;
+		mods = _mods;
+	}
+};
+
+//Events from the GLFW callbacks to whichever thread runs processInput(). Cursor
+//samples stop BUTTON_ROOM slots short of capacity, so a backlog of them can never
+//crowd out a press or release, whose loss would leave a drag or stroke open.
+class InputQueue {
+	static const size_t CAPACITY = 1024;
+	static const size_t BUTTON_ROOM = 64;
+	SpscQueue<InputEvent, CAPACITY> events;
+public:
+	bool push(const InputEvent& event) {
+		if (event.type == InputEventType::Move && events.size() >= CAPACITY - BUTTON_ROOM)
+			return false;
+		return events.push(event);
+	}
+	bool pop(InputEvent& event) {
+		return events.pop(event);
+	}
+};
+
+//Turns raw cursor samples into points spaced evenly along the drag path, so a
+//fast stroke is filled in between samples and a slow one does not repeat points.
+class StrokeResampler {
+	float spacing;
+	float untilNext; //distance left along the path before the next point
+	Vertex last;
+	bool active;
+public:
+	StrokeResampler(float _spacing = 0.004f) {
+		spacing = _spacing;
+		untilNext = 0;
+		active = false;
+	}
+	bool isActive() {
+		return active;
+	}
+	void begin(float x, float y, std::vector<Vertex>& out) {
+		active = true;
+		last = Vertex(x, y);
+		out.push_back(last);
+		untilNext = spacing;
+	}
+	void add(float x, float y, std::vector<Vertex>& out) {
+		if (!active)
+			return;
+		Vertex next(x, y);
+		Vertex delta = next - last;
+		float length = sqrtf(delta.x * delta.x + delta.y * delta.y);
+		float travelled = untilNext;
+		for (; travelled <= length; travelled += spacing) {
+			float t = travelled / length;
+			out.push_back(Vertex(last.x + delta.x * t, last.y + delta.y * t));
+		}
+		untilNext = travelled - length;
+		last = next;
+	}
+	void end(float x, float y, std::vector<Vertex>& out) {
+		add(x, y, out);
+		active = false;
+	}
+};
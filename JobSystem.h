@@ -0,0 +1,258 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Trace.h"
+
+class JobSystem;
+
+//Jobs forked together and joined with wait(). While waiting, the calling thread
+//runs queued jobs itself, so nested fork/join never leaves a thread idle.
+class JobGroup {
+	friend class JobSystem;
+	std::atomic<int> pending;
+public:
+	JobGroup() : pending(0) {}
+	JobGroup(const JobGroup&) = delete;
+	JobGroup& operator=(const JobGroup&) = delete;
+	~JobGroup() {
+		wait();
+	}
+	inline void wait();
+	bool isDone() {
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+};
+
+//Small work-stealing thread pool, one worker per hardware thread besides the
+//caller's. Every thread that forks jobs gets its own queue: it pushes and pops
+//at the back, where its most recent and most cache-warm work is, while idle
+//workers steal from the front of other queues. Queues are guarded by a mutex
+//each, which only contends while a steal is under way. Idle workers block until
+//a job is forked, so a pool with nothing to do costs no CPU.
+class JobSystem {
+	struct Job {
+		void (*run)(const void* task);
+		const void* task; //owned by whoever forked it and kept alive until its group is done
+		JobGroup* group;
+	};
+	struct Queue {
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+	static const int MAX_QUEUES = 64;
+	static const int MAX_WORKERS = MAX_QUEUES / 2; //queues below this are workers', the rest other threads'
+	std::unique_ptr<Queue> queues[MAX_QUEUES];
+	std::atomic<int> workerQueues, otherQueues; //in use in each half
+	std::vector<std::thread> workers;
+	std::atomic<bool> running;
+	std::atomic<int> queued; //jobs in any queue
+	std::atomic<int> sleeping;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+
+	template<typename F>
+	static void call(const void* task) {
+		(*(const F*)task)();
+	}
+	static int& threadQueue() {
+		static thread_local int index = -1;
+		return index;
+	}
+	//The calling thread's queue, registering it on first use. Threads other than
+	//workers take queues from the upper half, so a later setWorkerCount() never
+	//gives their queue to a worker too. Past MAX_QUEUES threads share the last
+	//one, which is still correct, just contended.
+	Queue& ownQueue() {
+		int& index = threadQueue();
+		if (index < 0) {
+			index = MAX_WORKERS + otherQueues.fetch_add(1);
+			if (index >= MAX_QUEUES)
+				index = MAX_QUEUES - 1;
+		}
+		return *queues[index];
+	}
+	bool pop(Job& job) {
+		Queue& queue = ownQueue();
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.jobs.empty())
+			return false;
+		job = queue.jobs.back();
+		queue.jobs.pop_back();
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	bool steal(Job& job) {
+		int workerCount = workerQueues.load(std::memory_order_acquire);
+		int otherCount = otherQueues.load(std::memory_order_acquire);
+		otherCount = otherCount < MAX_QUEUES - MAX_WORKERS ? otherCount : MAX_QUEUES - MAX_WORKERS;
+		//Queues in use are numbered workers' first, then the others'
+		int count = workerCount + otherCount;
+		int self = threadQueue();
+		int start = self < 0 ? 0 : (self < MAX_WORKERS ? self : workerCount + self - MAX_WORKERS) + 1;
+		for (int i = 0; i < count; i++) {
+			int index = (start + i) % count;
+			Queue& queue = *queues[index < workerCount ? index : MAX_WORKERS + index - workerCount];
+			std::unique_lock<std::mutex> guard(queue.lock, std::try_to_lock);
+			if (!guard.owns_lock() || queue.jobs.empty())
+				continue;
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+	void execute(const Job& job) {
+		job.run(job.task);
+		job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+	}
+	void workerLoop(int index) {
+		threadQueue() = index;
+		char name[32];
+		snprintf(name, sizeof(name), "job worker %d", index + 1);
+		Tracer::instance().setThreadName(name);
+		Job job;
+		while (running.load(std::memory_order_acquire)) {
+			if (pop(job) || steal(job)) {
+				execute(job);
+				continue;
+			}
+			std::unique_lock<std::mutex> guard(sleepLock);
+			//Counted before queued is checked: fork() bumps queued before reading
+			//sleeping, so one of the two always sees the other
+			sleeping.fetch_add(1);
+			wake.wait(guard, [&] { return queued.load() > 0 || !running.load(); });
+			sleeping.fetch_sub(1);
+		}
+	}
+	void startWorkers(int count) {
+		running.store(true);
+		for (int i = 0; i < count; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+	void stopWorkers() {
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			running.store(false);
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+	}
+	JobSystem() : workerQueues(0), otherQueues(0), running(false), queued(0), sleeping(0) {
+		for (int i = 0; i < MAX_QUEUES; i++)
+			queues[i].reset(new Queue());
+		int hardware = (int)std::thread::hardware_concurrency();
+		int count = hardware > 1 ? hardware - 1 : 0;
+		count = count < MAX_WORKERS ? count : MAX_WORKERS;
+		workerQueues.store(count);
+		startWorkers(count);
+	}
+public:
+	static JobSystem& instance() {
+		static JobSystem system;
+		return system;
+	}
+	~JobSystem() {
+		stopWorkers();
+	}
+	//Threads that run jobs, the caller included
+	int getThreadCount() {
+		return workers.size() + 1;
+	}
+	//Changes the number of workers; 0 runs every job on the thread that waits for it.
+	//Only call while no jobs are queued.
+	void setWorkerCount(int count) {
+		count = count < 0 ? 0 : count < MAX_WORKERS ? count : MAX_WORKERS;
+		if (count == (int)workers.size())
+			return;
+		stopWorkers();
+		//Queues of workers that went away are still searched, in case they hold jobs
+		if (workerQueues.load() < count)
+			workerQueues.store(count);
+		startWorkers(count);
+	}
+	//Queues task() to run on any thread. task must stay alive until group is done.
+	template<typename F>
+	void fork(JobGroup& group, const F& task) {
+		group.pending.fetch_add(1, std::memory_order_relaxed);
+		if (workers.empty()) {
+			task();
+			group.pending.fetch_sub(1, std::memory_order_release);
+			return;
+		}
+		Job job;
+		job.run = &call<F>;
+		job.task = &task;
+		job.group = &group;
+		Queue& queue = ownQueue();
+		{
+			std::lock_guard<std::mutex> guard(queue.lock);
+			queue.jobs.push_back(job);
+		}
+		queued.fetch_add(1);
+		//Once sleepLock is taken, a worker counted as sleeping is really waiting
+		//rather than between its check of queued and blocking, so it gets woken
+		if (sleeping.load() > 0) {
+			std::lock_guard<std::mutex> guard(sleepLock);
+			wake.notify_one();
+		}
+	}
+	//Runs queued jobs until everything forked into group has finished
+	void wait(JobGroup& group) {
+		Job job;
+		while (!group.isDone()) {
+			if (pop(job) || steal(job))
+				execute(job);
+			else
+				std::this_thread::yield();
+		}
+	}
+	//Calls body(first, last) over consecutive slices of [begin, end) in parallel,
+	//each at least grain long, and returns once all of them have. The slices are
+	//cut a few per thread so a thread that finishes early can steal more.
+	template<typename F>
+	void parallelFor(int begin, int end, int grain, const F& body) {
+		int count = end - begin;
+		if (count <= 0)
+			return;
+		grain = grain > 0 ? grain : 1;
+		int slices = (count + grain - 1) / grain;
+		int most = getThreadCount() * 4;
+		slices = slices < most ? slices : most;
+		if (slices <= 1) {
+			body(begin, end);
+			return;
+		}
+		TRACE_SCOPE("jobs", "parallelFor");
+		struct Slice {
+			const F* body;
+			int first, last;
+			void operator()() const {
+				(*body)(first, last);
+			}
+		};
+		std::vector<Slice> tasks(slices);
+		for (int i = 0; i < slices; i++) {
+			tasks[i].body = &body;
+			tasks[i].first = begin + (int)((long long)count * i / slices);
+			tasks[i].last = begin + (int)((long long)count * (i + 1) / slices);
+		}
+		JobGroup group;
+		for (int i = 1; i < slices; i++)
+			fork(group, tasks[i]);
+		tasks[0]();
+		wait(group);
+	}
+};
+
+inline void JobGroup::wait() {
+	if (!isDone())
+		JobSystem::instance().wait(*this);
+}
@@ -0,0 +1,318 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+//Levels below LOG_COMPILE_LEVEL are removed from the build entirely
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+enum class LogLevel { Trace, Debug, Info, Warn, Error, Off };
+enum class LogCategory { General, Input, Shader, Scene, Render, Count };
+
+const int LOG_CATEGORY_COUNT = (int)LogCategory::Count;
+
+//Runtime thresholds, one per category. A template so the header can define them.
+template<typename T = void>
+struct LogThreshold {
+	static std::atomic<int> levels[LOG_CATEGORY_COUNT];
+};
+template<typename T>
+std::atomic<int> LogThreshold<T>::levels[LOG_CATEGORY_COUNT] = {
+	{ (int)LogLevel::Info }, { (int)LogLevel::Info }, { (int)LogLevel::Info }, { (int)LogLevel::Info }, { (int)LogLevel::Info }
+};
+
+inline bool isLogEnabled(LogLevel level, LogCategory category) {
+	return (int)level >= LogThreshold<>::levels[(int)category].load(std::memory_order_relaxed);
+}
+
+//A log call captured without formatting. Arguments are packed by value into
+//payload and only turned into text by the background thread.
+struct LogRecord {
+	static const int PAYLOAD_SIZE = 464;
+	int (*format)(const LogRecord& record, char* out, size_t size);
+	const char* text;
+	double time;
+	LogLevel level;
+	LogCategory category;
+	int payloadSize;
+	alignas(8) unsigned char payload[PAYLOAD_SIZE];
+};
+
+class LogWriter {
+	LogRecord& record;
+public:
+	LogWriter(LogRecord& _record) : record(_record) {
+		record.payloadSize = 0;
+	}
+	void put(const void* data, int size) {
+		if (record.payloadSize + size > LogRecord::PAYLOAD_SIZE)
+			size = LogRecord::PAYLOAD_SIZE - record.payloadSize;
+		memcpy(record.payload + record.payloadSize, data, size);
+		record.payloadSize += size;
+	}
+	int remaining() {
+		return LogRecord::PAYLOAD_SIZE - record.payloadSize;
+	}
+};
+
+class LogReader {
+	const LogRecord& record;
+	int offset;
+public:
+	LogReader(const LogRecord& _record) : record(_record) {
+		offset = 0;
+	}
+	void get(void* data, int size) {
+		if (offset + size > record.payloadSize)
+			size = record.payloadSize - offset;
+		memcpy(data, record.payload + offset, size);
+		offset += size;
+	}
+	const char* getString() {
+		if (offset >= record.payloadSize)
+			return "";
+		const char* text = (const char*)record.payload + offset;
+		offset += strlen(text) + 1;
+		return text;
+	}
+};
+
+//Numbers and pointers are stored as raw bytes, strings are copied so the
+//caller's buffer may be gone by the time the record is formatted.
+template<typename T>
+struct LogCodec {
+	static_assert(std::is_arithmetic<T>::value || std::is_pointer<T>::value, "log arguments must be numbers, pointers or strings");
+	typedef T Decoded;
+	static void write(LogWriter& writer, T value) {
+		writer.put(&value, sizeof(T));
+	}
+	static T read(LogReader& reader) {
+		T value = T();
+		reader.get(&value, sizeof(T));
+		return value;
+	}
+};
+
+template<>
+struct LogCodec<const char*> {
+	typedef const char* Decoded;
+	static void write(LogWriter& writer, const char* value) {
+		if (value == NULL)
+			value = "(null)";
+		int length = strlen(value);
+		if (length > writer.remaining() - 1)
+			length = writer.remaining() - 1;
+		if (length < 0)
+			return;
+		writer.put(value, length);
+		writer.put("", 1);
+	}
+	static const char* read(LogReader& reader) {
+		return reader.getString();
+	}
+};
+
+template<>
+struct LogCodec<char*> : LogCodec<const char*> {};
+
+template<typename Tuple, size_t... I>
+int formatLogArguments(const char* text, char* out, size_t size, const Tuple& values, std::index_sequence<I...>) {
+	return snprintf(out, size, text, std::get<I>(values)...);
+}
+
+template<typename... Args>
+int formatLogRecord(const LogRecord& record, char* out, size_t size) {
+	LogReader reader(record);
+	//Braced initialisation guarantees the arguments are read back in order
+	std::tuple<typename LogCodec<Args>::Decoded...> values{ LogCodec<Args>::read(reader)... };
+	return formatLogArguments(record.text, out, size, values, std::index_sequence_for<Args...>());
+}
+
+template<typename... Args>
+void encodeLogArguments(LogWriter& writer, Args... args) {
+	int unused[] = { 0, (LogCodec<Args>::write(writer, args), 0)... };
+	(void)unused;
+}
+
+//Bounded multi-producer queue (Vyukov) drained by a single background thread.
+//Producers never block; when the queue is full the record is dropped and counted.
+//The thread sleeps while the queue is empty and is woken by the next push.
+class Logger {
+	static const size_t CAPACITY = 1024;
+	struct Cell {
+		std::atomic<size_t> sequence;
+		LogRecord record;
+	};
+	Cell* cells;
+	alignas(64) std::atomic<size_t> enqueuePosition;
+	alignas(64) size_t dequeuePosition;
+	std::atomic<size_t> dropped;
+	std::atomic<bool> running;
+	std::atomic<bool> sleeping;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::thread worker;
+	std::chrono::steady_clock::time_point start;
+	FILE* output;
+	LogRecord drained;
+
+	Logger() {
+		cells = new Cell[CAPACITY];
+		for (size_t i = 0; i < CAPACITY; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		enqueuePosition.store(0);
+		dequeuePosition = 0;
+		dropped.store(0);
+		sleeping.store(false);
+		start = std::chrono::steady_clock::now();
+		output = stdout;
+		running.store(true);
+		worker = std::thread(&Logger::drainLoop, this);
+	}
+	~Logger() {
+		shutdown();
+		delete[] cells;
+	}
+	bool push(const LogRecord& record) {
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &cells[position & (CAPACITY - 1)];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			long long difference = (long long)sequence - (long long)position;
+			if (difference == 0) {
+				if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (difference < 0)
+				return false;
+			else
+				position = enqueuePosition.load(std::memory_order_relaxed);
+		}
+		cell->record = record;
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+	bool isReady() {
+		return cells[dequeuePosition & (CAPACITY - 1)].sequence.load(std::memory_order_acquire) == dequeuePosition + 1;
+	}
+	bool pop(LogRecord& record) {
+		if (!isReady())
+			return false;
+		Cell* cell = &cells[dequeuePosition & (CAPACITY - 1)];
+		record = cell->record;
+		cell->sequence.store(dequeuePosition + CAPACITY, std::memory_order_release);
+		dequeuePosition++;
+		return true;
+	}
+	void print(const LogRecord& record) {
+		static const char* levelNames[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+		static const char* categoryNames[] = { "general", "input", "shader", "scene", "render" };
+		char message[1024];
+		record.format(record, message, sizeof(message));
+		fprintf(output, "[%10.6f] %-5s %-7s %s\n", record.time, levelNames[(int)record.level], categoryNames[(int)record.category], message);
+	}
+	int drain() {
+		int count = 0;
+		while (pop(drained)) {
+			print(drained);
+			count++;
+		}
+		size_t lost = dropped.exchange(0);
+		if (lost > 0)
+			fprintf(output, "[log] %zu messages dropped\n", lost);
+		if (count > 0 || lost > 0)
+			fflush(output);
+		return count;
+	}
+	void drainLoop() {
+		while (running.load(std::memory_order_acquire)) {
+			if (drain() > 0)
+				continue;
+			std::unique_lock<std::mutex> guard(sleepLock);
+			//Set before the queue is checked again: write() publishes a record before
+			//reading sleeping, and the fences make sure one of the two sees the other
+			sleeping.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			wake.wait(guard, [&] { return isReady() || !running.load(); });
+			sleeping.store(false);
+		}
+		drain();
+	}
+public:
+	static Logger& instance() {
+		static Logger logger;
+		return logger;
+	}
+	static void setLevel(LogLevel level) {
+		for (int i = 0; i < LOG_CATEGORY_COUNT; i++)
+			LogThreshold<>::levels[i].store((int)level, std::memory_order_relaxed);
+	}
+	static void setLevel(LogCategory category, LogLevel level) {
+		LogThreshold<>::levels[(int)category].store((int)level, std::memory_order_relaxed);
+	}
+	//Accepts trace, debug, info, warn, error or off
+	static bool parseLevel(const char* name, LogLevel& level) {
+		static const char* names[] = { "trace", "debug", "info", "warn", "error", "off" };
+		for (int i = 0; i <= (int)LogLevel::Off; i++) {
+			if (strcmp(name, names[i]) == 0) {
+				level = (LogLevel)i;
+				return true;
+			}
+		}
+		return false;
+	}
+	template<typename... Args>
+	void write(LogLevel level, LogCategory category, const char* text, Args... args) {
+		LogRecord record;
+		record.format = formatLogRecord<typename std::decay<Args>::type...>;
+		record.text = text;
+		record.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		record.level = level;
+		record.category = category;
+		LogWriter writer(record);
+		encodeLogArguments<typename std::decay<Args>::type...>(writer, args...);
+		if (!push(record)) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> guard(sleepLock);
+			wake.notify_one();
+		}
+	}
+	//Flushes everything queued so far and stops the background thread
+	void shutdown() {
+		bool wasRunning;
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			wasRunning = running.exchange(false);
+		}
+		if (!wasRunning)
+			return;
+		wake.notify_one();
+		worker.join();
+	}
+};
+
+#define LOG_AT(level, category, ...) \
+	do { \
+		if ((int)(level) >= LOG_COMPILE_LEVEL && isLogEnabled(level, category)) \
+			Logger::instance().write(level, category, __VA_ARGS__); \
+	} while (0)
+
+#define LOG_TRACE(category, ...) LOG_AT(LogLevel::Trace, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG_AT(LogLevel::Debug, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(LogLevel::Info, category, __VA_ARGS__)
+#define LOG_WARN(category, ...) LOG_AT(LogLevel::Warn, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG_AT(LogLevel::Error, category, __VA_ARGS__)
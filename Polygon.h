@@ -0,0 +1,494 @@
+#pragma once
+#include <math.h>
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <glew.h>
+#include "Shape.h"
+#include "Trace.h"
+
+//Cuts a simple polygon, with or without holes, into triangles in O(n log n).
+//A sweep from top to bottom adds diagonals at every vertex where the boundary
+//turns back on itself (split and merge vertices), which leaves pieces that are
+//monotone in y. Each piece is then walked as two chains merged by height and
+//fanned off a stack in linear time. Points are compared top first, then left
+//first at equal heights, so horizontal edges need no special casing.
+class Triangulator {
+	enum class Turn { Start, End, Split, Merge, Regular };
+	struct Point {
+		double x, y;
+	};
+	struct Event {
+		double y, x;
+		int index;
+	};
+	//Orders the edges crossing the sweep line from left to right at the current
+	//sweep point. Edges are named by the vertex they start from; -1 is the sweep
+	//point itself, for finding the edge to its left.
+	struct EdgeOrder {
+		const Triangulator* owner;
+		EdgeOrder(const Triangulator* _owner) : owner(_owner) {}
+		bool operator()(int a, int b) const {
+			if (a == b)
+				return false;
+			double xa = owner->xAt(a, owner->sweep.y), xb = owner->xAt(b, owner->sweep.y);
+			if (xa != xb || a < 0 || b < 0)
+				return xa < xb;
+			//Edges meeting at the sweep point: compare them lower down, where both still reach
+			double y = std::max(owner->lowerY(a), owner->lowerY(b));
+			if (y < owner->sweep.y) {
+				xa = owner->xAt(a, y);
+				xb = owner->xAt(b, y);
+				if (xa != xb)
+					return xa < xb;
+			}
+			return a < b;
+		}
+	};
+	typedef std::set<int, EdgeOrder> Status;
+
+	std::vector<Point> at; //by point index
+	std::vector<int> next, prev; //ring links by point index, interior on the left
+	std::vector<Turn> turn;
+	std::vector<int> order; //ring points, top first
+	std::vector<Event> events;
+	std::vector<double> slope; //per edge, dx / dy
+	std::vector<int> helper; //per edge: the lowest point above that a diagonal may go to
+	std::vector<Status::iterator> handles;
+	std::vector<unsigned char> inStatus;
+	Status status;
+	Point sweep;
+	std::vector<int> diagonals; //pairs of point indices
+	//Half-edges for splitting into monotone pieces, in pairs, so h ^ 1 runs the other way
+	std::vector<int> edgeFrom, edgeTo;
+	std::vector<unsigned char> edgeInside, edgeUsed;
+	std::vector<int> vertexEdges, vertexFirst, vertexFill, edgeSlot;
+	std::vector<double> edgeAngle;
+	std::vector<int> piece, sorted, chain, stack;
+	std::vector<GLuint>* out;
+	bool clockwise; //the outline as given, which every triangle is emitted to match
+
+	double xAt(int edge, double y) const {
+		if (edge < 0)
+			return sweep.x;
+		const Point& a = at[edge];
+		const Point& b = at[next[edge]];
+		if (a.y == b.y) //horizontal: only ever compared at its own height
+			return std::max(std::min(a.x, b.x), std::min(std::max(a.x, b.x), sweep.x));
+		return a.x + (y - a.y) * slope[edge];
+	}
+	double lowerY(int edge) const {
+		return std::min(at[edge].y, at[next[edge]].y);
+	}
+	//Whether point a is passed by the sweep before point b
+	bool above(int a, int b) const {
+		if (at[a].y != at[b].y)
+			return at[a].y > at[b].y;
+		if (at[a].x != at[b].x)
+			return at[a].x < at[b].x;
+		return a < b;
+	}
+	static double cross(const Point& o, const Point& a, const Point& b) {
+		return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+	}
+	//Rises with the direction of (dx, dy) the way atan2 does, without the trigonometry
+	static double pseudoAngle(double dx, double dy) {
+		double p = dx / (fabs(dx) + fabs(dy));
+		return dy < 0 ? p - 1 : 1 - p;
+	}
+	//Links one ring, dropping repeated points, so that the inside is on the left of
+	//every edge: counter-clockwise for the outline, clockwise for holes
+	bool linkRing(int first, int count, bool outline) {
+		int kept = 0, head = -1, tail = -1;
+		double area = 0;
+		for (int i = first; i < first + count; i++) {
+			if (tail >= 0 && at[i].x == at[tail].x && at[i].y == at[tail].y)
+				continue;
+			if (head < 0)
+				head = i;
+			else {
+				next[tail] = i;
+				area += at[tail].x * at[i].y - at[i].x * at[tail].y;
+			}
+			tail = i;
+			kept++;
+		}
+		if (kept > 1 && at[head].x == at[tail].x && at[head].y == at[tail].y) {
+			int last = tail;
+			for (tail = head; next[tail] != last; tail = next[tail])
+				;
+			kept--;
+		}
+		if (kept < 3)
+			return false;
+		next[tail] = head;
+		area += at[tail].x * at[head].y - at[head].x * at[tail].y;
+		//Reverse the links if the ring winds the other way
+		int v = head;
+		do {
+			prev[next[v]] = v;
+			v = next[v];
+		} while (v != head);
+		if (outline)
+			clockwise = area < 0;
+		if ((area > 0) != outline) {
+			v = head;
+			do {
+				int forward = next[v];
+				next[v] = prev[v];
+				prev[v] = forward;
+				v = forward;
+			} while (v != head);
+		}
+		v = head;
+		do {
+			order.push_back(v);
+			v = next[v];
+		} while (v != head);
+		return true;
+	}
+	void addDiagonal(int a, int b) {
+		if (next[a] != b && next[b] != a) {
+			diagonals.push_back(a);
+			diagonals.push_back(b);
+		}
+	}
+	void insertEdge(int v) {
+		handles[v] = status.insert(v).first;
+		inStatus[v] = 1;
+		helper[v] = v;
+	}
+	void removeEdge(int v) {
+		if (inStatus[v]) {
+			status.erase(handles[v]);
+			inStatus[v] = 0;
+		}
+	}
+	//Edge nearest the sweep point on its left, or -1
+	int leftOf() {
+		Status::iterator found = status.upper_bound(-1);
+		if (found == status.begin())
+			return -1;
+		return *--found;
+	}
+	//Closes off a merge vertex left as the helper of edge, once the sweep is past it
+	void fixMerge(int v, int edge) {
+		if (edge >= 0 && turn[helper[edge]] == Turn::Merge)
+			addDiagonal(v, helper[edge]);
+	}
+	void sweepDiagonals() {
+		events.resize(order.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			int v = order[i], p = prev[v], n = next[v];
+			events[i].y = at[v].y;
+			events[i].x = at[v].x;
+			events[i].index = v;
+			if (at[v].y != at[n].y)
+				slope[v] = (at[n].x - at[v].x) / (at[n].y - at[v].y);
+			bool pBelow = above(v, p), nBelow = above(v, n);
+			bool convex = cross(at[p], at[v], at[n]) > 0;
+			if (pBelow && nBelow)
+				turn[v] = convex ? Turn::Start : Turn::Split;
+			else if (!pBelow && !nBelow)
+				turn[v] = convex ? Turn::End : Turn::Merge;
+			else
+				turn[v] = Turn::Regular;
+		}
+		//The same order as above(), from copies of the coordinates so the sort stays in cache
+		std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+			if (a.y != b.y)
+				return a.y > b.y;
+			if (a.x != b.x)
+				return a.x < b.x;
+			return a.index < b.index;
+		});
+		for (size_t i = 0; i < events.size(); i++)
+			order[i] = events[i].index;
+		for (size_t i = 0; i < order.size(); i++) {
+			int v = order[i], p = prev[v];
+			sweep = at[v];
+			switch (turn[v]) {
+			case Turn::Start:
+				insertEdge(v);
+				break;
+			case Turn::End:
+				fixMerge(v, p);
+				removeEdge(p);
+				break;
+			case Turn::Split: {
+				int left = leftOf();
+				if (left >= 0) {
+					addDiagonal(v, helper[left]);
+					helper[left] = v;
+				}
+				insertEdge(v);
+				break;
+			}
+			case Turn::Merge: {
+				fixMerge(v, p);
+				removeEdge(p);
+				int left = leftOf();
+				fixMerge(v, left);
+				if (left >= 0)
+					helper[left] = v;
+				break;
+			}
+			default:
+				//On a left boundary the inside is to the right and the edge from above hands over to the one below
+				if (above(p, v)) {
+					fixMerge(v, p);
+					removeEdge(p);
+					insertEdge(v);
+				}
+				else {
+					int left = leftOf();
+					fixMerge(v, left);
+					if (left >= 0)
+						helper[left] = v;
+				}
+				break;
+			}
+		}
+		status.clear();
+	}
+	//a to b has the inside on its left; b to a as well for a diagonal, not for the boundary
+	void addHalfEdges(int a, int b, bool diagonal) {
+		edgeFrom.push_back(a);
+		edgeTo.push_back(b);
+		edgeInside.push_back(1);
+		edgeFrom.push_back(b);
+		edgeTo.push_back(a);
+		edgeInside.push_back(diagonal);
+	}
+	//Splits along the diagonals by walking each face of the outline plus diagonals:
+	//from every inside half-edge, keep taking the next edge clockwise at each point
+	void splitPieces(int pointCount) {
+		edgeFrom.clear();
+		edgeTo.clear();
+		edgeInside.clear();
+		for (size_t i = 0; i < order.size(); i++)
+			addHalfEdges(order[i], next[order[i]], false);
+		for (size_t i = 0; i < diagonals.size(); i += 2)
+			addHalfEdges(diagonals[i], diagonals[i + 1], true);
+		int edges = edgeFrom.size();
+		//Outgoing half-edges grouped by point and sorted by angle
+		vertexFirst.assign(pointCount + 1, 0);
+		for (int h = 0; h < edges; h++)
+			vertexFirst[edgeFrom[h] + 1]++;
+		for (int v = 0; v < pointCount; v++)
+			vertexFirst[v + 1] += vertexFirst[v];
+		vertexEdges.resize(edges);
+		edgeAngle.resize(edges);
+		edgeSlot.resize(edges);
+		vertexFill.assign(vertexFirst.begin(), vertexFirst.end() - 1);
+		for (int h = 0; h < edges; h++) {
+			vertexEdges[vertexFill[edgeFrom[h]]++] = h;
+			edgeAngle[h] = pseudoAngle(at[edgeTo[h]].x - at[edgeFrom[h]].x, at[edgeTo[h]].y - at[edgeFrom[h]].y);
+		}
+		for (size_t i = 0; i < order.size(); i++) {
+			int v = order[i];
+			std::sort(vertexEdges.begin() + vertexFirst[v], vertexEdges.begin() + vertexFirst[v + 1], [this](int a, int b) {
+				return edgeAngle[a] < edgeAngle[b];
+			});
+			for (int k = vertexFirst[v]; k < vertexFirst[v + 1]; k++)
+				edgeSlot[vertexEdges[k]] = k;
+		}
+		edgeUsed.assign(edges, 0);
+		for (int h = 0; h < edges; h++) {
+			if (!edgeInside[h] || edgeUsed[h])
+				continue;
+			piece.clear();
+			int e = h;
+			while (!edgeUsed[e]) {
+				edgeUsed[e] = 1;
+				piece.push_back(edgeFrom[e]);
+				int v = edgeTo[e];
+				int slot = edgeSlot[e ^ 1] - vertexFirst[v];
+				int degree = vertexFirst[v + 1] - vertexFirst[v];
+				e = vertexEdges[vertexFirst[v] + (slot + degree - 1) % degree];
+			}
+			triangulateMonotone();
+		}
+	}
+	//The fans below turn one way on the left chain and the other on the right, so
+	//each triangle is put the outline's way round here
+	void emit(int a, int b, int c) {
+		double area = cross(at[a], at[b], at[c]);
+		if (clockwise ? area > 0 : area < 0)
+			std::swap(b, c);
+		out->push_back(a);
+		out->push_back(b);
+		out->push_back(c);
+	}
+	//Fans a y-monotone piece, listed counter-clockwise in piece, off a stack of points
+	//that still need a triangle below them
+	void triangulateMonotone() {
+		int count = piece.size();
+		if (count < 3)
+			return;
+		if (count == 3) {
+			emit(piece[0], piece[1], piece[2]);
+			return;
+		}
+		int top = 0, bottom = 0;
+		for (int i = 1; i < count; i++) {
+			if (above(piece[i], piece[top]))
+				top = i;
+			if (above(piece[bottom], piece[i]))
+				bottom = i;
+		}
+		//Counter-clockwise from the top runs down the left chain, then up the right
+		chain.clear();
+		stack.clear();
+		int left = (top + 1) % count, right = (top + count - 1) % count;
+		sorted.clear();
+		sorted.push_back(piece[top]);
+		chain.push_back(0);
+		while (left != bottom || right != bottom) {
+			if (right == bottom || (left != bottom && above(piece[left], piece[right]))) {
+				sorted.push_back(piece[left]);
+				chain.push_back(-1);
+				left = (left + 1) % count;
+			}
+			else {
+				sorted.push_back(piece[right]);
+				chain.push_back(1);
+				right = (right + count - 1) % count;
+			}
+		}
+		sorted.push_back(piece[bottom]);
+		chain.push_back(0);
+
+		stack.push_back(0);
+		stack.push_back(1);
+		for (int j = 2; j < count - 1; j++) {
+			if (chain[j] != chain[stack.back()]) {
+				//Opposite chain: everything on the stack is visible
+				for (size_t k = 1; k < stack.size(); k++)
+					emit(sorted[j], sorted[stack[k - 1]], sorted[stack[k]]);
+				int last = stack.back();
+				stack.clear();
+				stack.push_back(last);
+				stack.push_back(j);
+			}
+			else {
+				//Same chain: cut while the corner at the last point is convex on the inside
+				int last = stack.back();
+				stack.pop_back();
+				while (!stack.empty()) {
+					double turn = cross(at[sorted[stack.back()]], at[sorted[last]], at[sorted[j]]);
+					if (chain[j] < 0 ? turn <= 0 : turn >= 0)
+						break;
+					emit(sorted[j], sorted[last], sorted[stack.back()]);
+					last = stack.back();
+					stack.pop_back();
+				}
+				stack.push_back(last);
+				stack.push_back(j);
+			}
+		}
+		for (size_t k = 1; k < stack.size(); k++)
+			emit(sorted[count - 1], sorted[stack[k - 1]], sorted[stack[k]]);
+	}
+public:
+	Triangulator() : status(EdgeOrder(this)) {
+		out = NULL;
+		clockwise = false;
+		sweep.x = sweep.y = 0;
+	}
+	Triangulator(const Triangulator&) = delete;
+	Triangulator& operator=(const Triangulator&) = delete;
+	//Ring r has ringSizes[r] points, taken one after another from points: the outline
+	//first, then any holes. Either winding works for any ring, and z is ignored.
+	//Holes must lie inside the outline without crossing it or each other.
+	//Appends three indices into points per triangle, each winding the way the
+	//outline does, and returns the triangle count.
+	int triangulate(const Vertex* points, const int* ringSizes, int ringCount, std::vector<GLuint>& indices) {
+		TRACE_SCOPE("scene", "Triangulator::triangulate");
+		int total = 0;
+		for (int r = 0; r < ringCount; r++)
+			total += ringSizes[r];
+		if (ringCount <= 0 || ringSizes[0] < 3)
+			return 0;
+		at.resize(total);
+		for (int i = 0; i < total; i++) {
+			at[i].x = points[i].x;
+			at[i].y = points[i].y;
+		}
+		next.assign(total, -1);
+		prev.assign(total, -1);
+		order.clear();
+		if (!linkRing(0, ringSizes[0], true))
+			return 0;
+		for (int r = 1, first = ringSizes[0]; r < ringCount; first += ringSizes[r], r++)
+			linkRing(first, ringSizes[r], false);
+
+		turn.resize(total);
+		slope.resize(total);
+		helper.resize(total);
+		handles.resize(total);
+		inStatus.assign(total, 0);
+		diagonals.clear();
+		sweepDiagonals();
+
+		size_t start = indices.size();
+		indices.reserve(start + (order.size() + 2 * (ringCount - 1)) * 3);
+		out = &indices;
+		splitPieces(total);
+		out = NULL;
+		return (indices.size() - start) / 3;
+	}
+};
+
+//A flat shape filled from its outline, with optional holes, rather than from
+//triangles listed by hand. The triangulation is kept as indices into the
+//outline's points, so the shape uploads each point once and draws through the
+//same buffer, index and hit-test paths as shapes loaded from a scene file.
+class Polygon : public Shape {
+	void build(const Vertex* _points, const int* ringSizes, int ringCount) {
+		static thread_local Triangulator triangulator;
+		static thread_local std::vector<GLuint> triangles;
+		pointSize = 0;
+		for (int r = 0; r < ringCount; r++)
+			pointSize += ringSizes[r];
+		triangles.clear();
+		if (triangulator.triangulate(_points, ringSizes, ringCount, triangles) == 0) {
+			pointSize = 0; //nothing to fill
+			return;
+		}
+		points = allocateArray<Vertex>(pointSize, pointsInArena);
+		for (int i = 0; i < pointSize; i++)
+			setPoint(i, _points[i]);
+		bool indicesFromArena;
+		GLuint* owned = allocateArray<GLuint>(triangles.size(), indicesFromArena);
+		std::copy(triangles.begin(), triangles.end(), owned);
+		adoptIndices(owned, triangles.size(), indicesFromArena);
+		position = Vertex((bounds.lower.x + bounds.upper.x) / 2, (bounds.lower.y + bounds.upper.y) / 2, _points[0].z);
+	}
+public:
+	//A polygon without holes; the outline may wind either way
+	Polygon(const Vertex* outline, int count) {
+		build(outline, &count, 1);
+	}
+	//points holds ringSizes[0] outline points followed by each hole's points in turn
+	Polygon(const Vertex* points, const int* ringSizes, int ringCount) {
+		build(points, ringSizes, ringCount);
+	}
+	int getTriangleCount() {
+		return indexCount / 3;
+	}
+};
+
+//An outline filled through the stencil buffer instead of being triangulated, for
+//outlines that change too often to triangulate every time, such as one being
+//edited or animated. Each change uploads the outline's points and a cover quad,
+//nothing more. The outline may wind either way and even cross itself; rule
+//decides which of the areas it encloses are filled.
+class StencilPolygon : public Shape {
+public:
+	StencilPolygon(const Vertex* outline, int count, FillRule rule = FillRule::NonZero) {
+		fill = rule;
+		reshape(outline, count);
+		position = Vertex((bounds.lower.x + bounds.upper.x) / 2, (bounds.lower.y + bounds.upper.y) / 2, count > 0 ? outline[0].z : 0);
+	}
+};
@@ -0,0 +1,317 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Shape.h"
+#include "Stroke.h"
+#include "Arena.h"
+#include "Bvh.h"
+#include "JobSystem.h"
+#include "Trace.h"
+
+enum class SceneItemType { Shape, Box, Stroke };
+
+//One thing found by a scene query: which array it is in and where
+struct SceneItem {
+	SceneItemType type;
+	int index;
+	SceneItem(SceneItemType _type = SceneItemType::Shape, int _index = -1) : type(_type), index(_index) {}
+};
+
+//Owns every shape it draws, stored by value in contiguous arrays so drawing walks
+//memory in order. Only the drawable Shape part of a Triangle, Circle, Ovaloid or
+//Vase is kept once it has been generated. Vertex storage comes from one arena that
+//clear() rewinds in a single step, so rebuilding or drawing into a scene does not
+//go back to the general-purpose heap once it has warmed up; shapes built on job
+//threads use an arena per thread, rewound along with it. Anything whose bounds
+//fall outside the view is skipped when drawing, and a hierarchy over the same
+//bounds answers spatial questions without scanning every shape.
+class Scene {
+	Arena arena;
+	std::vector<Shape> shapes;
+	std::vector<Box> boxes;
+	std::vector<Stroke> strokes;
+	Bounds view;
+	BoundsList shapeBounds, boxBounds, strokeBounds;
+	std::vector<int> visibleShapes, visibleBoxes, visibleStrokes;
+	Bvh shapeTree, boxTree, strokeTree;
+	std::vector<int> queryHits;
+	std::vector<SceneItem> pickCandidates;
+	std::vector<std::vector<int>> sliceVisible;
+	std::mutex threadArenaLock;
+	std::vector<std::thread::id> threadArenaOwners;
+	std::vector<std::unique_ptr<Arena>> threadArenas;
+
+	//Culls a long list in slices on the job system, joining what each found in order
+	void cull(const BoundsList& list, std::vector<int>& visible) {
+		const int SLICE = 1 << 14;
+		int count = list.size();
+		if (count <= SLICE) {
+			list.cull(view, visible);
+			return;
+		}
+		int slices = (count + SLICE - 1) / SLICE;
+		if (sliceVisible.size() < slices)
+			sliceVisible.resize(slices);
+		JobSystem::instance().parallelFor(0, slices, 1, [&](int first, int last) {
+			for (int slice = first; slice < last; slice++) {
+				sliceVisible[slice].clear();
+				list.cull(view, sliceVisible[slice], slice * SLICE, std::min((slice + 1) * SLICE, count));
+			}
+		});
+		for (int slice = 0; slice < slices; slice++)
+			visible.insert(visible.end(), sliceVisible[slice].begin(), sliceVisible[slice].end());
+	}
+	//Appends one kind of query hit in draw order, so the topmost comes last
+	void collect(SceneItemType type, std::vector<SceneItem>& found) {
+		std::sort(queryHits.begin(), queryHits.end());
+		for (int i = 0; i < queryHits.size(); i++)
+			found.push_back(SceneItem(type, queryHits[i]));
+		queryHits.clear();
+	}
+public:
+	Scene(size_t reservedBytes = 4 << 20) : arena(reservedBytes), view(Vertex(-1, -1, -1), Vertex(1, 1, 1)) {
+		strokes.reserve(4096);
+	}
+	//Shapes point back into the scene's bounds lists, so the scene stays where it is
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+	~Scene() {
+		clear();
+	}
+	//Builds a Triangle, Circle, Ovaloid, Vase, Box or Stroke and moves it into the
+	//scene. The returned reference is only valid until the next create().
+	template<typename T, typename... Args>
+	auto& create(Args&&... args) {
+		ArenaScope scope(arena);
+		return store(T(std::forward<Args>(args)...));
+	}
+	//Moves in a shape built elsewhere, such as on another thread inside an
+	//ArenaScope over getThreadArena(). Only one thread may store at a time.
+	Shape& store(Shape&& shape) {
+		shapes.push_back(std::move(shape));
+		shapes.back().trackBounds(&shapeBounds);
+		return shapes.back();
+	}
+	Box& store(Box&& box) {
+		boxes.push_back(std::move(box));
+		boxes.back().trackBounds(&boxBounds);
+		return boxes.back();
+	}
+	Stroke& store(Stroke&& stroke) {
+		strokes.push_back(std::move(stroke));
+		strokes.back().trackBounds(&strokeBounds);
+		return strokes.back();
+	}
+	//An arena of the scene's for the calling thread alone, so shapes can be built
+	//on several threads at once and still be released together by clear()
+	Arena& getThreadArena() {
+		std::lock_guard<std::mutex> guard(threadArenaLock);
+		std::thread::id self = std::this_thread::get_id();
+		for (size_t i = 0; i < threadArenaOwners.size(); i++)
+			if (threadArenaOwners[i] == self)
+				return *threadArenas[i];
+		threadArenaOwners.push_back(self);
+		threadArenas.push_back(std::unique_ptr<Arena>(new Arena()));
+		return *threadArenas.back();
+	}
+	int getShapeCount() {
+		return shapes.size();
+	}
+	int getBoxCount() {
+		return boxes.size();
+	}
+	Shape* getShape(int index) {
+		return &shapes[index];
+	}
+	Box* getBox(int index) {
+		return &boxes[index];
+	}
+	int getStrokeCount() {
+		return strokes.size();
+	}
+	Stroke* getStroke(int index) {
+		return &strokes[index];
+	}
+	//The region being looked at, in the same coordinates as the points. Defaults to clip space.
+	void setView(const Bounds& _view) {
+		view = _view;
+	}
+	Bounds getView() {
+		return view;
+	}
+	//Shapes, boxes and strokes that passed the view test in the last draw()
+	int getDrawnCount() {
+		return visibleShapes.size() + visibleBoxes.size() + visibleStrokes.size();
+	}
+	//Tests every bounds against the view. Shapes keep their copy in the flat
+	//arrays current as they move, so this never has to visit the shapes themselves.
+	void cull() {
+		TRACE_SCOPE("render", "Scene::cull");
+		visibleShapes.clear();
+		visibleBoxes.clear();
+		visibleStrokes.clear();
+		cull(shapeBounds, visibleShapes);
+		cull(boxBounds, visibleBoxes);
+		cull(strokeBounds, visibleStrokes);
+	}
+	//Brings the hierarchies up to date with everything moved or added since the
+	//last query. The find functions call this themselves.
+	void updateIndex() {
+		TRACE_SCOPE("scene", "Scene::updateIndex");
+		shapeTree.update(shapeBounds);
+		boxTree.update(boxBounds);
+		strokeTree.update(strokeBounds);
+	}
+	//Everything whose bounds contain the point, in draw order: shapes, then boxes, then strokes
+	void findAt(float x, float y, std::vector<SceneItem>& found) {
+		updateIndex();
+		shapeTree.queryPoint(x, y, queryHits);
+		collect(SceneItemType::Shape, found);
+		boxTree.queryPoint(x, y, queryHits);
+		collect(SceneItemType::Box, found);
+		strokeTree.queryPoint(x, y, queryHits);
+		collect(SceneItemType::Stroke, found);
+	}
+	//Everything whose bounds overlap rect in x and y, in draw order
+	void findIn(const Bounds& rect, std::vector<SceneItem>& found) {
+		updateIndex();
+		shapeTree.queryRect(rect, queryHits);
+		collect(SceneItemType::Shape, found);
+		boxTree.queryRect(rect, queryHits);
+		collect(SceneItemType::Box, found);
+		strokeTree.queryRect(rect, queryHits);
+		collect(SceneItemType::Stroke, found);
+	}
+	//Everything whose bounds the ray crosses within length multiples of direction, in draw order
+	void findAlong(const Vertex& origin, const Vertex& direction, float length, std::vector<SceneItem>& found) {
+		updateIndex();
+		shapeTree.queryRay(origin, direction, length, queryHits);
+		collect(SceneItemType::Shape, found);
+		boxTree.queryRay(origin, direction, length, queryHits);
+		collect(SceneItemType::Box, found);
+		strokeTree.queryRay(origin, direction, length, queryHits);
+		collect(SceneItemType::Stroke, found);
+	}
+	//Finds the topmost shape, box or stroke whose triangles cover the point. The
+	//hierarchy narrows it to the few whose bounds do; those are tested exactly,
+	//last drawn first, so the search stops at the one on top.
+	bool pick(float x, float y, SceneItem& picked) {
+		TRACE_SCOPE("scene", "Scene::pick");
+		pickCandidates.clear();
+		findAt(x, y, pickCandidates);
+		for (int i = (int)pickCandidates.size() - 1; i >= 0; i--) {
+			if (contains(pickCandidates[i], x, y)) {
+				picked = pickCandidates[i];
+				return true;
+			}
+		}
+		return false;
+	}
+	Bounds getBounds(const SceneItem& item) {
+		switch (item.type) {
+		case SceneItemType::Shape:
+			return shapes[item.index].getBounds();
+		case SceneItemType::Box:
+			return boxes[item.index].getBounds();
+		default:
+			return strokes[item.index].getBounds();
+		}
+	}
+	bool contains(const SceneItem& item, float x, float y) {
+		switch (item.type) {
+		case SceneItemType::Shape:
+			return shapes[item.index].contains(x, y);
+		case SceneItemType::Box:
+			return boxes[item.index].contains(x, y);
+		default:
+			return strokes[item.index].contains(x, y);
+		}
+	}
+	void translate(const SceneItem& item, const Vertex& movement) {
+		switch (item.type) {
+		case SceneItemType::Shape:
+			shapes[item.index].translate(movement);
+			break;
+		case SceneItemType::Box:
+			boxes[item.index].translate(movement);
+			break;
+		default:
+			strokes[item.index].translate(movement);
+			break;
+		}
+	}
+	size_t getReservedBytes() {
+		size_t total = arena.getReserved();
+		for (size_t i = 0; i < threadArenas.size(); i++)
+			total += threadArenas[i]->getReserved();
+		return total;
+	}
+	long long getVertexCount() {
+		long long count = 0;
+		for (int i = 0; i < shapes.size(); i++)
+			count += shapes[i].getPointSize();
+		for (int i = 0; i < boxes.size(); i++)
+			count += boxes[i].getPointSize();
+		for (int i = 0; i < strokes.size(); i++)
+			count += strokes[i].getPointSize();
+		return count;
+	}
+	void initiateBuffer() {
+		for (int i = 0; i < shapes.size(); i++)
+			shapes[i].initiateBuffer();
+		for (int i = 0; i < boxes.size(); i++)
+			boxes[i].initiateBuffer();
+	}
+	void draw() {
+		TRACE_SCOPE("render", "Scene::draw");
+		cull();
+		for (int i = 0; i < visibleShapes.size(); i++) {
+			shapes[visibleShapes[i]].drawPolygon();
+			shapes[visibleShapes[i]].drawPolyline();
+		}
+		for (int i = 0; i < visibleBoxes.size(); i++) {
+			boxes[visibleBoxes[i]].drawPolygon();
+			boxes[visibleBoxes[i]].drawPolyline();
+		}
+		for (int i = 0; i < visibleStrokes.size(); i++)
+			strokes[visibleStrokes[i]].drawPolygon();
+	}
+	//Same as draw(), written into list instead of issued. Strokes draw from list
+	//slots numbered by their index, so each keeps its own buffer on the GL side.
+	void record(CommandList& list) {
+		TRACE_SCOPE("scene", "Scene::record");
+		cull();
+		for (int i = 0; i < visibleShapes.size(); i++) {
+			shapes[visibleShapes[i]].recordPolygon(list);
+			shapes[visibleShapes[i]].recordPolyline(list);
+		}
+		for (int i = 0; i < visibleBoxes.size(); i++) {
+			boxes[visibleBoxes[i]].recordPolygon(list);
+			boxes[visibleBoxes[i]].recordPolyline(list);
+		}
+		for (int i = 0; i < visibleStrokes.size(); i++)
+			strokes[visibleStrokes[i]].recordPolygon(list, visibleStrokes[i]);
+	}
+	//Releases GL buffers and hands all vertex memory back to the arena at once
+	void clear() {
+		shapes.clear();
+		boxes.clear();
+		strokes.clear();
+		shapeBounds.clear();
+		boxBounds.clear();
+		strokeBounds.clear();
+		visibleShapes.clear();
+		visibleBoxes.clear();
+		visibleStrokes.clear();
+		shapeTree.clear();
+		boxTree.clear();
+		strokeTree.clear();
+		arena.reset();
+		for (size_t i = 0; i < threadArenas.size(); i++)
+			threadArenas[i]->reset();
+	}
+};
@@ -0,0 +1,460 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef NOGDI
+#define NOGDI
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "Logger.h"
+#include "Shader.h"
+#include "Scene.h"
+#include "Polygon.h"
+
+//Binary scene file, version 1. Little-endian, every block 64-byte aligned:
+//
+//  header | vertices | indices | shapes | materials
+//
+//Vertices are Vertex (three floats) and indices are GLuint relative to the
+//shape's first vertex, so both blocks can be handed to glBufferData as they are.
+const char SCENE_FILE_MAGIC[4] = { 'S', 'P', 'S', 'C' };
+const uint32_t SCENE_FILE_VERSION = 1;
+const uint64_t SCENE_FILE_ALIGNMENT = 64;
+
+enum class SceneShapeType : uint32_t { Polygon, Box, Stroke };
+
+struct SceneFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t shapeCount, materialCount;
+	uint64_t vertexCount, indexCount;
+	uint64_t vertexOffset, indexOffset, shapeOffset, materialOffset;
+	uint64_t fileSize;
+};
+
+struct SceneFileShape {
+	uint32_t type;
+	int32_t material, outlineMaterial; //-1 when the shape has none
+	uint32_t reserved;
+	float position[3];
+	float euler[3][3];
+	uint64_t firstVertex, vertexCount;
+	uint64_t firstIndex, indexCount; //indexCount 0 draws the vertices in order
+};
+
+//A shader program by the files it was built from
+struct SceneFileMaterial {
+	char vertexShader[128];
+	char fragmentShader[128];
+};
+
+static_assert(sizeof(Vertex) == 3 * sizeof(float), "vertex block is read as Vertex");
+static_assert(sizeof(SceneFileHeader) == 72, "scene file header layout changed");
+static_assert(sizeof(SceneFileShape) == 96, "scene file shape layout changed");
+static_assert(sizeof(SceneFileMaterial) == 256, "scene file material layout changed");
+
+//Read-only view of a whole file, released when it goes out of scope
+class MappedFile {
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+public:
+	MappedFile() {
+		data = NULL;
+		size = 0;
+#ifdef _WIN32
+		file = mapping = NULL;
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() {
+		close();
+	}
+	bool open(const char* path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			file = NULL;
+			return false;
+		}
+		LARGE_INTEGER length;
+		if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data == NULL) {
+			close();
+			return false;
+		}
+		size = (size_t)length.QuadPart;
+#else
+		int descriptor = ::open(path, O_RDONLY);
+		if (descriptor < 0)
+			return false;
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+			::close(descriptor);
+			return false;
+		}
+		void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		//The mapping keeps the file alive on its own
+		::close(descriptor);
+		if (mapped == MAP_FAILED)
+			return false;
+		data = (const unsigned char*)mapped;
+		size = info.st_size;
+#endif
+		return true;
+	}
+	void close() {
+#ifdef _WIN32
+		if (data != NULL)
+			UnmapViewOfFile(data);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != NULL)
+			CloseHandle(file);
+		file = mapping = NULL;
+#else
+		if (data != NULL)
+			munmap((void*)data, size);
+#endif
+		data = NULL;
+		size = 0;
+	}
+	const unsigned char* getData() {
+		return data;
+	}
+	size_t getSize() {
+		return size;
+	}
+};
+
+//A scene file mapped into memory. Shapes loaded from it draw straight from the
+//mapping, so it must stay open for as long as they are in a scene.
+class SceneFile {
+	MappedFile file;
+	const SceneFileHeader* header;
+	std::vector<GLuint> programs; //per material, 0 until first used
+
+	bool blockFits(uint64_t offset, uint64_t count, uint64_t itemSize) {
+		if (offset % SCENE_FILE_ALIGNMENT != 0 || offset > file.getSize())
+			return false;
+		return count <= (file.getSize() - offset) / itemSize;
+	}
+	bool validate() {
+		if (file.getSize() < sizeof(SceneFileHeader))
+			return false;
+		if (memcmp(header->magic, SCENE_FILE_MAGIC, 4) != 0 || header->version != SCENE_FILE_VERSION || header->fileSize != file.getSize())
+			return false;
+		if (!blockFits(header->vertexOffset, header->vertexCount, sizeof(Vertex)) || !blockFits(header->indexOffset, header->indexCount, sizeof(GLuint)) ||
+			!blockFits(header->shapeOffset, header->shapeCount, sizeof(SceneFileShape)) || !blockFits(header->materialOffset, header->materialCount, sizeof(SceneFileMaterial)))
+			return false;
+		//Index values are checked by loadShape(), when the shape's pages are read anyway
+		for (uint32_t i = 0; i < header->shapeCount; i++) {
+			const SceneFileShape& shape = getShapes()[i];
+			if (shape.firstVertex > header->vertexCount || shape.vertexCount > header->vertexCount - shape.firstVertex || shape.vertexCount > INT32_MAX)
+				return false;
+			if (shape.firstIndex > header->indexCount || shape.indexCount > header->indexCount - shape.firstIndex || shape.indexCount > INT32_MAX)
+				return false;
+			if (shape.material < -1 || shape.material >= (int32_t)header->materialCount || shape.outlineMaterial < -1 || shape.outlineMaterial >= (int32_t)header->materialCount)
+				return false;
+		}
+		return true;
+	}
+	GLuint loadMaterial(int index) {
+		if (index < 0)
+			return 0;
+		if (programs[index] != 0)
+			return programs[index];
+		SceneFileMaterial material = getMaterials()[index];
+		material.vertexShader[sizeof(material.vertexShader) - 1] = '\0';
+		material.fragmentShader[sizeof(material.fragmentShader) - 1] = '\0';
+		programs[index] = LoadShadersCached(material.vertexShader, material.fragmentShader);
+		return programs[index];
+	}
+public:
+	SceneFile() {
+		header = NULL;
+	}
+	bool open(const char* path) {
+		close();
+		if (!file.open(path)) {
+			LOG_ERROR(LogCategory::Scene, "cannot map scene file %s", path);
+			return false;
+		}
+		header = (const SceneFileHeader*)file.getData();
+		if (!validate()) {
+			LOG_ERROR(LogCategory::Scene, "%s is not a version %u scene file or is damaged", path, SCENE_FILE_VERSION);
+			close();
+			return false;
+		}
+		programs.assign(header->materialCount, 0);
+		LOG_DEBUG(LogCategory::Scene, "mapped %s: %u shapes, %llu vertices, %llu indices", path, header->shapeCount,
+			(unsigned long long)header->vertexCount, (unsigned long long)header->indexCount);
+		return true;
+	}
+	void close() {
+		file.close();
+		header = NULL;
+		programs.clear();
+	}
+	bool isOpen() {
+		return header != NULL;
+	}
+	int getShapeCount() {
+		return header != NULL ? header->shapeCount : 0;
+	}
+	const SceneFileShape* getShapes() {
+		return (const SceneFileShape*)(file.getData() + header->shapeOffset);
+	}
+	const Vertex* getVertices() {
+		return (const Vertex*)(file.getData() + header->vertexOffset);
+	}
+	const GLuint* getIndices() {
+		return (const GLuint*)(file.getData() + header->indexOffset);
+	}
+	const SceneFileMaterial* getMaterials() {
+		return (const SceneFileMaterial*)(file.getData() + header->materialOffset);
+	}
+	//Adds one shape to the scene without uploading it. Every shape becomes a plain
+	//Shape whose points and indices stay in the mapping. A shape with an index
+	//past its own vertices is left out, since picking, saving and drawing would
+	//all read past them; NULL is returned for it.
+	Shape* loadShape(Scene& scene, int index) {
+		const SceneFileShape& record = getShapes()[index];
+		const GLuint* indices = getIndices() + record.firstIndex;
+		for (uint64_t i = 0; i < record.indexCount; i++)
+			if (indices[i] >= record.vertexCount) {
+				LOG_WARN(LogCategory::Scene, "shape %d skipped: index %u is past its %llu vertices", index, indices[i], (unsigned long long)record.vertexCount);
+				return NULL;
+			}
+		Shape& shape = scene.create<Shape>(getVertices() + record.firstVertex, (int)record.vertexCount,
+			Vertex(record.position[0], record.position[1], record.position[2]));
+		for (int i = 0; i < 3; i++)
+			shape.setEuler(i, Vertex(record.euler[i][0], record.euler[i][1], record.euler[i][2]));
+		if (record.indexCount > 0)
+			shape.setIndices(indices, (int)record.indexCount);
+		shape.setShader(loadMaterial(record.material));
+		shape.setOutlineShader(loadMaterial(record.outlineMaterial));
+		return &shape;
+	}
+	//Adds every shape in the file to the scene and uploads them. Returns how many were added.
+	int load(Scene& scene) {
+		int first = scene.getShapeCount();
+		for (int i = 0; i < getShapeCount(); i++)
+			loadShape(scene, i);
+		for (int i = first; i < scene.getShapeCount(); i++)
+			scene.getShape(i)->initiateBuffer();
+		return scene.getShapeCount() - first;
+	}
+
+	//Writes every shape, box and stroke in the scene. Repeated vertices within a
+	//shape are merged and drawn through indices.
+	static bool write(const char* path, Scene& scene);
+};
+
+//Collects shapes into the file's blocks before they are written out
+class SceneFileWriter {
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+	std::vector<SceneFileShape> shapes;
+	std::vector<SceneFileMaterial> materials;
+	std::unordered_map<GLuint, int> materialIndex;
+
+	struct VertexKey {
+		uint32_t bits[3];
+		bool operator==(const VertexKey& other) const {
+			return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+		}
+	};
+	struct VertexKeyHash {
+		size_t operator()(const VertexKey& key) const {
+			return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+		}
+	};
+
+	int addMaterial(GLuint program) {
+		if (program == 0)
+			return -1;
+		std::unordered_map<GLuint, int>::iterator found = materialIndex.find(program);
+		if (found != materialIndex.end())
+			return found->second;
+		std::string vertex, fragment;
+		SceneFileMaterial material;
+		memset(&material, 0, sizeof(material));
+		if (!findShaderFiles(program, vertex, fragment) || vertex.size() >= sizeof(material.vertexShader) || fragment.size() >= sizeof(material.fragmentShader)) {
+			LOG_WARN(LogCategory::Scene, "shader program %u was not loaded from files, saving the shape without it", program);
+			materialIndex[program] = -1;
+			return -1;
+		}
+		memcpy(material.vertexShader, vertex.c_str(), vertex.size());
+		memcpy(material.fragmentShader, fragment.c_str(), fragment.size());
+		materials.push_back(material);
+		materialIndex[program] = materials.size() - 1;
+		return materials.size() - 1;
+	}
+	static void pad(FILE* out, uint64_t& written) {
+		static const unsigned char zeros[SCENE_FILE_ALIGNMENT] = {};
+		uint64_t padding = (SCENE_FILE_ALIGNMENT - written % SCENE_FILE_ALIGNMENT) % SCENE_FILE_ALIGNMENT;
+		fwrite(zeros, 1, padding, out);
+		written += padding;
+	}
+	static void put(FILE* out, uint64_t& written, const void* data, size_t size) {
+		if (size > 0)
+			fwrite(data, 1, size, out);
+		written += size;
+	}
+public:
+	void add(SceneShapeType type, const Vertex* points, int count, const Vertex& position, const Vertex* euler, GLuint shader, GLuint outlineShader) {
+		SceneFileShape record;
+		memset(&record, 0, sizeof(record));
+		record.type = (uint32_t)type;
+		record.material = addMaterial(shader);
+		record.outlineMaterial = addMaterial(outlineShader);
+		record.position[0] = position.x;
+		record.position[1] = position.y;
+		record.position[2] = position.z;
+		for (int i = 0; i < 3; i++) {
+			record.euler[i][0] = euler[i].x;
+			record.euler[i][1] = euler[i].y;
+			record.euler[i][2] = euler[i].z;
+		}
+		record.firstVertex = vertices.size();
+		record.firstIndex = indices.size();
+
+		std::unordered_map<VertexKey, GLuint, VertexKeyHash> unique;
+		unique.reserve(count);
+		for (int i = 0; i < count; i++) {
+			VertexKey key;
+			memcpy(key.bits, &points[i], sizeof(key.bits));
+			std::pair<std::unordered_map<VertexKey, GLuint, VertexKeyHash>::iterator, bool> inserted =
+				unique.insert(std::make_pair(key, (GLuint)(vertices.size() - record.firstVertex)));
+			if (inserted.second)
+				vertices.push_back(points[i]);
+			indices.push_back(inserted.first->second);
+		}
+		record.vertexCount = vertices.size() - record.firstVertex;
+		record.indexCount = indices.size() - record.firstIndex;
+		//Nothing repeated, so drawing in order is the same and the indices are dropped
+		if (record.vertexCount == record.indexCount) {
+			indices.resize(record.firstIndex);
+			record.indexCount = 0;
+		}
+		shapes.push_back(record);
+	}
+	bool write(const char* path) {
+		FILE* out = fopen(path, "wb");
+		if (out == NULL) {
+			LOG_ERROR(LogCategory::Scene, "cannot create scene file %s", path);
+			return false;
+		}
+		SceneFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, SCENE_FILE_MAGIC, 4);
+		header.version = SCENE_FILE_VERSION;
+		header.shapeCount = shapes.size();
+		header.materialCount = materials.size();
+		header.vertexCount = vertices.size();
+		header.indexCount = indices.size();
+
+		//Lay out the blocks first so the header can be written in one go
+		uint64_t offset = sizeof(SceneFileHeader);
+		uint64_t* offsets[] = { &header.vertexOffset, &header.indexOffset, &header.shapeOffset, &header.materialOffset };
+		uint64_t sizes[] = { vertices.size() * sizeof(Vertex), indices.size() * sizeof(GLuint), shapes.size() * sizeof(SceneFileShape), materials.size() * sizeof(SceneFileMaterial) };
+		for (int i = 0; i < 4; i++) {
+			offset += (SCENE_FILE_ALIGNMENT - offset % SCENE_FILE_ALIGNMENT) % SCENE_FILE_ALIGNMENT;
+			*offsets[i] = offset;
+			offset += sizes[i];
+		}
+		header.fileSize = offset;
+
+		uint64_t written = 0;
+		put(out, written, &header, sizeof(header));
+		const void* blocks[] = { vertices.data(), indices.data(), shapes.data(), materials.data() };
+		for (int i = 0; i < 4; i++) {
+			pad(out, written);
+			put(out, written, blocks[i], sizes[i]);
+		}
+		bool failed = ferror(out) != 0;
+		if (fclose(out) != 0 || failed) {
+			LOG_ERROR(LogCategory::Scene, "failed writing scene file %s", path);
+			return false;
+		}
+		LOG_INFO(LogCategory::Scene, "saved %s: %d shapes, %d vertices, %d indices", path, (int)shapes.size(), (int)vertices.size(), (int)indices.size());
+		return true;
+	}
+};
+
+inline bool SceneFile::write(const char* path, Scene& scene) {
+	SceneFileWriter writer;
+	for (int i = 0; i < scene.getShapeCount(); i++) {
+		Shape* shape = scene.getShape(i);
+		Vertex euler[3] = { shape->getEuler(0), shape->getEuler(1), shape->getEuler(2) };
+		//Stencil-filled outlines have no triangles of their own. Files store their
+		//triangulation, which fills the same area unless the outline crosses itself.
+		if (shape->getFillRule() != FillRule::Triangles) {
+			Triangulator triangulator;
+			std::vector<GLuint> triangles;
+			int count = shape->getPointSize();
+			triangulator.triangulate(shape->getPoints(), &count, 1, triangles);
+			if (triangles.empty()) //nothing drawn yet, like a lasso before its first drag
+				continue;
+			std::vector<Vertex> expanded(triangles.size());
+			for (size_t j = 0; j < triangles.size(); j++)
+				expanded[j] = shape->getPoints()[triangles[j]];
+			writer.add(SceneShapeType::Polygon, expanded.data(), expanded.size(), shape->getPosition(), euler, shape->getShader(), shape->getOutlineShader());
+		}
+		//Shapes that already draw through indices are written out expanded and merged again
+		else if (shape->getIndexCount() > 0) {
+			std::vector<Vertex> expanded(shape->getIndexCount());
+			for (int j = 0; j < shape->getIndexCount(); j++)
+				expanded[j] = shape->getPoints()[shape->getIndices()[j]];
+			writer.add(SceneShapeType::Polygon, expanded.data(), expanded.size(), shape->getPosition(), euler, shape->getShader(), shape->getOutlineShader());
+		}
+		else
+			writer.add(SceneShapeType::Polygon, shape->getPoints(), shape->getPointSize(), shape->getPosition(), euler, shape->getShader(), shape->getOutlineShader());
+	}
+	for (int i = 0; i < scene.getBoxCount(); i++) {
+		Box* box = scene.getBox(i);
+		Vertex points[12 * 3];
+		for (int t = 0; t < 12; t++)
+			for (int j = 0; j < 3; j++)
+				points[t * 3 + j] = box->getTriangle(t)->getPoints()[j];
+		Triangle* first = box->getTriangle(0);
+		Vertex euler[3] = { first->getEuler(0), first->getEuler(1), first->getEuler(2) };
+		writer.add(SceneShapeType::Box, points, 12 * 3, box->getPosition(), euler, first->getShader(), first->getOutlineShader());
+	}
+	for (int i = 0; i < scene.getStrokeCount(); i++) {
+		Stroke* stroke = scene.getStroke(i);
+		Vertex euler[3] = { Vertex(1, 0, 0), Vertex(0, 1, 0), Vertex(0, 0, 1) };
+		writer.add(SceneShapeType::Stroke, stroke->getPoints(), stroke->getPointSize(), Vertex(), euler, stroke->getShader(), 0);
+	}
+	return writer.write(path);
+}
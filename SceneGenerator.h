@@ -0,0 +1,175 @@
+#pragma once
+#include <random>
+#include "Scene.h"
+#include "JobSystem.h"
+#include "Trace.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI //its Polygon() would hide the Polygon shape
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+//Relative weights of each shape type in a generated scene
+struct ShapeMix {
+	int triangle, circle, box, ovaloid, vase;
+	ShapeMix(int _triangle = 4, int _circle = 4, int _box = 1, int _ovaloid = 1, int _vase = 1) {
+		triangle = _triangle;
+		circle = _circle;
+		box = _box;
+		ovaloid = _ovaloid;
+		vase = _vase;
+	}
+	int getTotal() {
+		return triangle + circle + box + ovaloid + vase;
+	}
+};
+
+//Fills a scene with a reproducible mix of shapes for scaling tests. The random
+//choices are made in order on the calling thread and the shapes then built on the
+//job system, so a seed gives the same scene however many threads there are.
+class SceneGenerator {
+	enum class Kind { Triangle, Circle, Box, Ovaloid, Vase };
+	//Everything drawn from the generator for one shape
+	struct ShapeSpec {
+		Kind kind;
+		float size;
+		Vertex center;
+		Vertex pts[3]; //Triangle only
+	};
+	//Shapes are built in batches of this many, each batch on one thread
+	static const int BATCH = 1024;
+
+	std::mt19937 random;
+	ShapeMix mix;
+	float extent; //shapes are placed inside [-extent, extent] on x and y
+	float uniform(float min, float max) {
+		return std::uniform_real_distribution<float>(min, max)(random);
+	}
+	Vertex randomPoint(float size) {
+		return Vertex(uniform(-extent + size, extent - size), uniform(-extent + size, extent - size));
+	}
+	static void build(ShapeSpec& spec, std::vector<Shape>& shapes, std::vector<Box>& boxes) {
+		float size = spec.size;
+		Vertex center = spec.center;
+		switch (spec.kind) {
+		case Kind::Triangle:
+			shapes.push_back(Triangle(spec.pts, center.x, center.y));
+			break;
+		case Kind::Circle:
+			shapes.push_back(Circle(center.x, center.y, 0, 24, size, 1));
+			break;
+		case Kind::Box:
+			boxes.push_back(Box(center.x, center.y, 0, size, size, size));
+			break;
+		case Kind::Ovaloid:
+			shapes.push_back(Ovaloid(center.x, center.y, 0, 8, Vertex(size, size * 0.6f), 1.0f, 4));
+			break;
+		default: {
+			Vertex control[] = { Vertex(size * 0.3f, -size), Vertex(size, 0), Vertex(size * 0.2f, size) };
+			shapes.push_back(Vase(control, 3, center.x, center.y, 0, 8, 1.0f, 4));
+			break;
+		}
+		}
+	}
+public:
+	static const unsigned DEFAULT_SEED = 29;
+
+	SceneGenerator(ShapeMix _mix = ShapeMix(), unsigned seed = DEFAULT_SEED, float _extent = 1.0f) : random(seed) {
+		mix = _mix;
+		extent = _extent;
+	}
+	void generate(Scene& scene, int count) {
+		TRACE_SCOPE("scene", "SceneGenerator::generate");
+		int total = mix.getTotal();
+		if (total <= 0 || count <= 0)
+			return;
+		std::vector<ShapeSpec> specs(count);
+		for (int i = 0; i < count; i++) {
+			ShapeSpec& spec = specs[i];
+			int pick = std::uniform_int_distribution<int>(0, total - 1)(random);
+			spec.size = uniform(0.01f, 0.05f);
+			spec.center = randomPoint(spec.size);
+			if ((pick -= mix.triangle) < 0) {
+				spec.kind = Kind::Triangle;
+				for (int j = 0; j < 3; j++)
+					spec.pts[j] = spec.center + Vertex(uniform(-spec.size, spec.size), uniform(-spec.size, spec.size));
+			}
+			else if ((pick -= mix.circle) < 0)
+				spec.kind = Kind::Circle;
+			else if ((pick -= mix.box) < 0)
+				spec.kind = Kind::Box;
+			else if ((pick -= mix.ovaloid) < 0)
+				spec.kind = Kind::Ovaloid;
+			else
+				spec.kind = Kind::Vase;
+		}
+
+		//Each batch keeps its shapes apart until all are built, then they are stored
+		//batch by batch, in the order a single thread would have made them
+		int batches = (count + BATCH - 1) / BATCH;
+		std::vector<std::vector<Shape>> batchShapes(batches);
+		std::vector<std::vector<Box>> batchBoxes(batches);
+		JobSystem::instance().parallelFor(0, batches, 1, [&](int first, int last) {
+			ArenaScope scope(scene.getThreadArena());
+			for (int batch = first; batch < last; batch++) {
+				int end = std::min((batch + 1) * BATCH, count);
+				for (int i = batch * BATCH; i < end; i++)
+					build(specs[i], batchShapes[batch], batchBoxes[batch]);
+			}
+		});
+		for (int batch = 0; batch < batches; batch++) {
+			for (size_t i = 0; i < batchShapes[batch].size(); i++)
+				scene.store(std::move(batchShapes[batch][i]));
+			for (size_t i = 0; i < batchBoxes[batch].size(); i++)
+				scene.store(std::move(batchBoxes[batch][i]));
+		}
+	}
+	//Uploads the generated geometry and assigns each shape a colour from the shared palette
+	void initiate(Scene& scene) {
+		TRACE_SCOPE("scene", "SceneGenerator::initiate");
+		const char vertex[] = "shaders/triangle/vertex_1.shader";
+		const char* palette[] = {
+			"shaders/triangle/red.shader", "shaders/triangle/blue.shader", "shaders/triangle/green.shader",
+			"shaders/triangle/yellow.shader", "shaders/triangle/brown.shader", "shaders/triangle/grey.shader",
+			"shaders/triangle/white.shader", "shaders/triangle/black.shader"
+		};
+		const char outline[] = "shaders/triangle/fragment_outline_2.shader";
+		const int paletteSize = sizeof(palette) / sizeof(palette[0]);
+
+		scene.initiateBuffer();
+		for (int i = 0; i < scene.getShapeCount(); i++) {
+			scene.getShape(i)->initiateShader(vertex, palette[i % paletteSize]);
+			scene.getShape(i)->initiateOutlineShader(vertex, outline);
+		}
+		for (int i = 0; i < scene.getBoxCount(); i++) {
+			scene.getBox(i)->initiateShader(vertex, palette[i % paletteSize]);
+			scene.getBox(i)->initiateOutlineShader(vertex, outline);
+		}
+	}
+};
+
+//Resident set size of the process in bytes, or 0 where it cannot be queried
+inline size_t getResidentMemory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	long pages = 0, resident = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL)
+		return 0;
+	if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(statm);
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "SceneFile.h"
+#include "SpscQueue.h"
+#include "Trace.h"
+
+//Brings a mapped scene file into a scene a little at a time. A worker thread
+//walks the file in chunks and faults their pages in, so the render thread
+//never waits on the disk. Each frame, update() turns ready chunks into shapes
+//and uploads them until the frame's byte budget is spent. The scene can be
+//drawn the whole time and fills in as loading goes on.
+class SceneStreamer {
+	struct Chunk {
+		int firstShape, endShape;
+	};
+	SceneFile& file;
+	size_t frameBudget, chunkBytes;
+	SpscQueue<Chunk, 256> ready;
+	std::thread worker;
+	std::atomic<bool> stopping;
+	std::atomic<bool> readFinished;
+	Chunk current;
+	int nextShape, loadedShapes;
+
+	static size_t shapeBytes(const SceneFileShape& shape) {
+		return shape.vertexCount * sizeof(Vertex) + shape.indexCount * sizeof(GLuint);
+	}
+	//Reads one byte per page so the page is resident before the render thread uploads it
+	static unsigned touch(const void* data, size_t size) {
+		const size_t PAGE = 4096;
+		const volatile unsigned char* bytes = (const volatile unsigned char*)data;
+		unsigned sum = 0;
+		for (size_t offset = 0; offset < size; offset += PAGE)
+			sum += bytes[offset];
+		if (size > 0)
+			sum += bytes[size - 1];
+		return sum;
+	}
+	void readLoop() {
+		Tracer::instance().setThreadName("scene streamer");
+		const SceneFileShape* shapes = file.getShapes();
+		int count = file.getShapeCount();
+		unsigned sum = 0;
+		Chunk chunk;
+		chunk.firstShape = 0;
+		size_t bytes = 0;
+		int64_t chunkStart = Tracer::isEnabled() ? Tracer::instance().now() : 0;
+		for (int i = 0; i < count && !stopping.load(std::memory_order_relaxed); i++) {
+			const SceneFileShape& shape = shapes[i];
+			sum += touch(file.getVertices() + shape.firstVertex, shape.vertexCount * sizeof(Vertex));
+			sum += touch(file.getIndices() + shape.firstIndex, shape.indexCount * sizeof(GLuint));
+			bytes += shapeBytes(shape);
+			if (bytes < chunkBytes && i + 1 < count)
+				continue;
+			chunk.endShape = i + 1;
+			if (TRACE_ENABLED && Tracer::isEnabled())
+				Tracer::instance().record("scene", "read chunk", chunkStart, Tracer::instance().now());
+			while (!ready.push(chunk)) {
+				if (stopping.load(std::memory_order_relaxed))
+					return;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			chunk.firstShape = i + 1;
+			bytes = 0;
+			chunkStart = Tracer::isEnabled() ? Tracer::instance().now() : 0;
+		}
+		(void)sum;
+		readFinished.store(true, std::memory_order_release);
+	}
+public:
+	SceneStreamer(SceneFile& _file, size_t _frameBudget = 4 << 20, size_t _chunkBytes = 1 << 20) : file(_file) {
+		frameBudget = _frameBudget;
+		chunkBytes = _chunkBytes;
+		stopping.store(false);
+		readFinished.store(false);
+		current.firstShape = current.endShape = 0;
+		nextShape = 0;
+		loadedShapes = 0;
+	}
+	SceneStreamer(const SceneStreamer&) = delete;
+	SceneStreamer& operator=(const SceneStreamer&) = delete;
+	~SceneStreamer() {
+		stop();
+	}
+	void start() {
+		stop();
+		stopping.store(false);
+		readFinished.store(file.getShapeCount() == 0);
+		if (!readFinished.load())
+			worker = std::thread(&SceneStreamer::readLoop, this);
+	}
+	//Stops reading; shapes already in the scene stay there
+	void stop() {
+		stopping.store(true);
+		if (worker.joinable())
+			worker.join();
+	}
+	//Call once per frame on the GL thread. Returns the number of shapes added.
+	int update(Scene& scene) {
+		TRACE_SCOPE("scene", "SceneStreamer::update");
+		int added = 0, visited = 0;
+		size_t spent = 0;
+		//Always make some progress, even if a single shape is over budget
+		while (spent < frameBudget || visited == 0) {
+			if (nextShape == current.endShape) {
+				if (!ready.pop(current))
+					break;
+				nextShape = current.firstShape;
+			}
+			Shape* shape = file.loadShape(scene, nextShape);
+			if (shape != NULL) {
+				shape->initiateBuffer();
+				added++;
+			}
+			spent += shapeBytes(file.getShapes()[nextShape]);
+			nextShape++;
+			visited++;
+		}
+		loadedShapes += added;
+		if (visited > 0 && isDone())
+			LOG_INFO(LogCategory::Scene, "streamed %d shapes", loadedShapes);
+		return added;
+	}
+	bool isDone() {
+		return readFinished.load(std::memory_order_acquire) && ready.size() == 0 && nextShape == current.endShape;
+	}
+	int getLoadedShapes() {
+		return loadedShapes;
+	}
+};
@@ -1,3 +1,4 @@
+#pragma once
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,93 +8,56 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <map>
+#include "Logger.h"
+#include "Trace.h"
+#include "GLHandle.h"
+#include "ShaderCompiler.h"
 using namespace std;
 
-GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path) {
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}
-	else {
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
-		return 0;
-	}
-
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
-
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const* VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+// Builds a program and waits until it is linked, for code that cannot draw with a
+// placeholder in the meantime. Returns 0 if it failed to build.
+inline GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path) {
+	ShaderCompiler& compiler = ShaderCompiler::instance();
+	GLuint program = compiler.submit(vertex_file_path, fragment_file_path);
+	compiler.finish();
+	if (compiler.isReady(program))
+		return program;
+	glDeleteProgram(program);
+	return 0;
+}
+
+// Programs are shared by every shape that uses the same pair of files, so a
+// scene compiles each combination once no matter how many shapes it holds.
+// Keyed by "vertex|fragment". New programs are built in the background by
+// ShaderCompiler; draw with resolveProgram() so nothing waits on them.
+inline std::map<std::string, GLProgram>& shaderProgramCache() {
+	static std::map<std::string, GLProgram> programs;
+	return programs;
+}
+
+inline GLuint LoadShadersCached(const char* vertex_file_path, const char* fragment_file_path) {
+	TRACE_SCOPE("shader", "LoadShadersCached", fragment_file_path);
+	std::map<std::string, GLProgram>& programs = shaderProgramCache();
+	std::string key = std::string(vertex_file_path) + "|" + fragment_file_path;
+	std::map<std::string, GLProgram>::iterator found = programs.find(key);
+	if (found != programs.end())
+		return found->second.get();
+	GLuint program = ShaderCompiler::instance().submit(vertex_file_path, fragment_file_path);
+	programs[key] = GLProgram(program);
+	return program;
+}
+
+// Reverse lookup for cached programs, used when saving a scene
+inline bool findShaderFiles(GLuint program, std::string& vertex_file_path, std::string& fragment_file_path) {
+	std::map<std::string, GLProgram>& programs = shaderProgramCache();
+	for (std::map<std::string, GLProgram>::iterator it = programs.begin(); it != programs.end(); ++it) {
+		if (program != 0 && it->second.get() == program) {
+			size_t split = it->first.find('|');
+			vertex_file_path = it->first.substr(0, split);
+			fragment_file_path = it->first.substr(split + 1);
+			return true;
+		}
 	}
-
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const* FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
-	}
-
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
-	}
-
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
-}
\ No newline at end of file
+	return false;
+}
@@ -0,0 +1,472 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <glew.h>
+#include "Logger.h"
+#include "Trace.h"
+#include "SpscQueue.h"
+#include "ShaderSources.h"
+
+//Development override: read shaders/ from disk instead of the copies built in
+inline bool& shaderSourcesFromDisk() {
+	static bool fromDisk = false;
+	return fromDisk;
+}
+
+//Source of a shader by its path under shaders/. Built-in copies are used unless
+//overridden; paths that were not embedded are read from disk.
+inline bool readShaderSource(const std::string& path, std::string& text) {
+	if (!shaderSourcesFromDisk()) {
+		for (int i = 0; i < EMBEDDED_SHADER_COUNT; i++) {
+			if (path == EMBEDDED_SHADERS[i].path) {
+				text = EMBEDDED_SHADERS[i].source;
+				return true;
+			}
+		}
+	}
+	std::ifstream stream(path.c_str(), std::ios::in);
+	if (!stream.is_open())
+		return false;
+	std::stringstream buffer;
+	buffer << stream.rdbuf();
+	text = buffer.str();
+	return true;
+}
+
+//Builds shader programs without stalling the render thread. submit() hands out
+//the program name at once; the files are read on a worker thread, compiled and
+//linked on the next poll() and only checked for errors on a later one, so the
+//driver can work on every program at the same time. Until a program is ready,
+//resolve() gives a flat placeholder program to draw with instead. Neither thread
+//polls: each blocks on wake until the other has given it work or room.
+//
+//Linked programs are also saved with glGetProgramBinary, keyed by a hash of both
+//sources and the driver, so later starts restore them without compiling GLSL.
+class ShaderCompiler {
+	enum ProgramState : unsigned char { Unknown, Pending, Ready, Failed };
+	struct Job {
+		GLuint program;
+		std::string vertexPath, fragmentPath;
+		std::string vertexSource, fragmentSource;
+		bool read;
+		uint64_t key; //hash of both sources and the driver, names the cache file
+		std::vector<char> binary; //cached program, empty if there was none
+		GLenum binaryFormat;
+	};
+	struct Linking {
+		Job* job;
+		GLuint vertex, fragment;
+		unsigned linkedAt; //poll count when glLinkProgram was issued
+	};
+	static const size_t QUEUE_SIZE = 256;
+	SpscQueue<Job*, QUEUE_SIZE> toRead, toCompile, toWrite;
+	std::thread reader;
+	std::atomic<bool> running;
+	std::atomic<int> sleepers; //threads blocked in sleepUntil()
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::vector<Linking> linking;
+	std::vector<unsigned char> states; //indexed by program name
+	GLuint placeholder;
+	bool parallel; //driver has GL_KHR_parallel_shader_compile
+	unsigned polls;
+	int outstanding;
+	std::string cacheDirectory; //empty when the binary cache is off
+	std::string driver; //vendor, renderer and version; binaries only load on the same one
+	bool binaries; //driver can hand out program binaries
+	int restored;
+
+	ShaderCompiler() {
+		running.store(false);
+		sleepers.store(0);
+		placeholder = 0;
+		parallel = false;
+		polls = 0;
+		outstanding = 0;
+		cacheDirectory = "shader_cache";
+		binaries = false;
+		restored = 0;
+	}
+	~ShaderCompiler() {
+		shutdown();
+	}
+	//FNV-1a
+	static uint64_t hash(const std::string& text, uint64_t value = 14695981039346656037ull) {
+		for (size_t i = 0; i < text.size(); i++) {
+			value ^= (unsigned char)text[i];
+			value *= 1099511628211ull;
+		}
+		return value;
+	}
+	std::string cachePath(uint64_t key) {
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+		return cacheDirectory + name;
+	}
+	//Cache file: magic, key, binary format, length, then the binary itself
+	struct CacheHeader {
+		char magic[4];
+		uint32_t format;
+		uint64_t key;
+		uint64_t length;
+	};
+	void loadBinary(Job* job) {
+		FILE* file = fopen(cachePath(job->key).c_str(), "rb");
+		if (file == NULL)
+			return;
+		CacheHeader header;
+		if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "SPBC", 4) == 0 && header.key == job->key && header.length < (64u << 20)) {
+			job->binary.resize(header.length);
+			if (fread(job->binary.data(), 1, header.length, file) != header.length)
+				job->binary.clear();
+			job->binaryFormat = header.format;
+		}
+		fclose(file);
+	}
+	void saveBinary(Job* job) {
+		TRACE_SCOPE("shader", "save binary", job->fragmentPath.c_str());
+#ifdef _WIN32
+		_mkdir(cacheDirectory.c_str());
+#else
+		mkdir(cacheDirectory.c_str(), 0755);
+#endif
+		//Written under a temporary name so a crash never leaves a torn entry behind
+		std::string path = cachePath(job->key), temporary = path + ".tmp";
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (file == NULL)
+			return;
+		CacheHeader header;
+		memcpy(header.magic, "SPBC", 4);
+		header.format = job->binaryFormat;
+		header.key = job->key;
+		header.length = job->binary.size();
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(job->binary.data(), 1, job->binary.size(), file) == job->binary.size();
+		if (fclose(file) == 0 && written) {
+			remove(path.c_str());
+			rename(temporary.c_str(), path.c_str());
+		}
+		else
+			remove(temporary.c_str());
+	}
+	void readLoop() {
+		Tracer::instance().setThreadName("shader reader");
+		while (running.load(std::memory_order_acquire)) {
+			Job* job;
+			if (toWrite.pop(job)) {
+				saveBinary(job);
+				delete job;
+				wakeSleepers(); //shutdown() waits for the writes
+				continue;
+			}
+			if (!toRead.pop(job)) {
+				sleepUntil([&] { return toRead.size() > 0 || toWrite.size() > 0 || !running.load(); });
+				continue;
+			}
+			wakeSleepers(); //submit() may be waiting for room
+			{
+				TRACE_SCOPE("shader", "read sources", job->fragmentPath.c_str());
+				job->read = readShaderSource(job->vertexPath, job->vertexSource) && readShaderSource(job->fragmentPath, job->fragmentSource);
+				if (job->read && binaries) {
+					job->key = hash(job->vertexSource + '\0' + job->fragmentSource + '\0' + driver);
+					loadBinary(job);
+				}
+			}
+			while (!toCompile.push(job)) {
+				sleepUntil([&] { return toCompile.size() < QUEUE_SIZE || !running.load(); });
+				if (!running.load()) {
+					delete job;
+					return;
+				}
+			}
+			wakeSleepers();
+		}
+	}
+	//Blocks until ready() holds. Whichever thread changes what it reads calls
+	//wakeSleepers() afterwards; the count goes up before ready() is checked and
+	//the fences on both sides make sure one of the two sees the other.
+	template<typename F>
+	void sleepUntil(const F& ready) {
+		std::unique_lock<std::mutex> guard(sleepLock);
+		sleepers.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		wake.wait(guard, ready);
+		sleepers.fetch_sub(1);
+	}
+	//Call after pushing to or popping from a queue
+	void wakeSleepers() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> guard(sleepLock);
+			wake.notify_all();
+		}
+	}
+	static GLuint compile(GLenum type, const char* source) {
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		return shader;
+	}
+	static bool checkShader(GLuint shader, const std::string& path) {
+		GLint result = GL_FALSE, length = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+		if (length > 0) {
+			std::vector<char> message(length + 1);
+			glGetShaderInfoLog(shader, length, NULL, &message[0]);
+			LOG_WARN(LogCategory::Shader, "%s: %s", path.c_str(), &message[0]);
+		}
+		return result == GL_TRUE;
+	}
+	void setState(GLuint program, ProgramState state) {
+		if (program >= states.size())
+			states.resize(program + 64, Unknown);
+		states[program] = state;
+	}
+	//Issues compiles and links for every job whose sources have arrived, without waiting on any of them
+	void startCompiles() {
+		Job* job;
+		while (toCompile.pop(job)) {
+			wakeSleepers(); //the reader may be waiting for room
+			if (!job->read) {
+				LOG_ERROR(LogCategory::Shader, "Impossible to open %s or %s. Are you in the right directory ?", job->vertexPath.c_str(), job->fragmentPath.c_str());
+				setState(job->program, Failed);
+				outstanding--;
+				delete job;
+				continue;
+			}
+			bool fromCache = false;
+			{
+				//The span names the job's file, so a restored job is only freed once it has ended
+				TRACE_SCOPE("shader", "start compile", job->fragmentPath.c_str());
+				if (!job->binary.empty()) {
+					glProgramBinary(job->program, job->binaryFormat, job->binary.data(), job->binary.size());
+					GLint linked = GL_FALSE;
+					glGetProgramiv(job->program, GL_LINK_STATUS, &linked);
+					if (linked == GL_TRUE) {
+						LOG_DEBUG(LogCategory::Shader, "Restored cached program : %s, %s", job->vertexPath.c_str(), job->fragmentPath.c_str());
+						setState(job->program, Ready);
+						outstanding--;
+						restored++;
+						fromCache = true;
+					}
+					else {
+						//Driver update or a stale entry: compile as if there were no cache
+						LOG_DEBUG(LogCategory::Shader, "Cached program for %s, %s was rejected", job->vertexPath.c_str(), job->fragmentPath.c_str());
+						job->binary.clear();
+					}
+				}
+				if (!fromCache) {
+					LOG_DEBUG(LogCategory::Shader, "Compiling shaders : %s, %s", job->vertexPath.c_str(), job->fragmentPath.c_str());
+					Linking entry;
+					entry.job = job;
+					entry.vertex = compile(GL_VERTEX_SHADER, job->vertexSource.c_str());
+					entry.fragment = compile(GL_FRAGMENT_SHADER, job->fragmentSource.c_str());
+					glAttachShader(job->program, entry.vertex);
+					glAttachShader(job->program, entry.fragment);
+					if (binaries)
+						glProgramParameteri(job->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+					glLinkProgram(job->program);
+					entry.linkedAt = polls;
+					linking.push_back(entry);
+				}
+			}
+			if (fromCache)
+				delete job;
+		}
+	}
+	void finishLink(Linking& entry) {
+		Job* job = entry.job;
+		bool cacheable = false;
+		{
+			//Likewise ends before the job is handed off or freed
+			TRACE_SCOPE("shader", "finish link", job->fragmentPath.c_str());
+			bool compiled = checkShader(entry.vertex, job->vertexPath);
+			compiled = checkShader(entry.fragment, job->fragmentPath) && compiled;
+			GLint result = GL_FALSE, length = 0;
+			glGetProgramiv(job->program, GL_LINK_STATUS, &result);
+			glGetProgramiv(job->program, GL_INFO_LOG_LENGTH, &length);
+			if (length > 0) {
+				std::vector<char> message(length + 1);
+				glGetProgramInfoLog(job->program, length, NULL, &message[0]);
+				LOG_WARN(LogCategory::Shader, "Linking %s + %s: %s", job->vertexPath.c_str(), job->fragmentPath.c_str(), &message[0]);
+			}
+			glDetachShader(job->program, entry.vertex);
+			glDetachShader(job->program, entry.fragment);
+			glDeleteShader(entry.vertex);
+			glDeleteShader(entry.fragment);
+			setState(job->program, compiled && result == GL_TRUE ? Ready : Failed);
+			outstanding--;
+			if (binaries && compiled && result == GL_TRUE) {
+				GLint size = 0;
+				glGetProgramiv(job->program, GL_PROGRAM_BINARY_LENGTH, &size);
+				if (size > 0) {
+					job->binary.resize(size);
+					glGetProgramBinary(job->program, size, NULL, &job->binaryFormat, job->binary.data());
+					cacheable = true;
+				}
+			}
+		}
+		//The worker writes it out; if it is backed up the entry is simply not cached
+		if (cacheable && toWrite.push(job)) {
+			wakeSleepers();
+			return;
+		}
+		delete job;
+	}
+	void createPlaceholder() {
+		const char* vertex =
+			"#version 330 core\n"
+			"layout(location = 0) in vec3 vertexPosition_modelspace;\n"
+			"void main() { gl_Position = vec4(vertexPosition_modelspace, 1.0); }\n";
+		const char* fragment =
+			"#version 330 core\n"
+			"out vec3 color;\n"
+			"void main() { color = vec3(0.5, 0.5, 0.5); }\n";
+		GLuint vertexShader = compile(GL_VERTEX_SHADER, vertex);
+		GLuint fragmentShader = compile(GL_FRAGMENT_SHADER, fragment);
+		placeholder = glCreateProgram();
+		glAttachShader(placeholder, vertexShader);
+		glAttachShader(placeholder, fragmentShader);
+		glLinkProgram(placeholder);
+		glDetachShader(placeholder, vertexShader);
+		glDetachShader(placeholder, fragmentShader);
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+	}
+	void start() {
+		parallel = GLEW_KHR_parallel_shader_compile != 0;
+		if (parallel)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); //let the driver pick
+		LOG_DEBUG(LogCategory::Shader, "Parallel shader compile %s", parallel ? "available" : "not available");
+		GLint formats = 0;
+		if (GLEW_ARB_get_program_binary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		binaries = !cacheDirectory.empty() && formats > 0;
+		const GLubyte* names[] = { glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION) };
+		driver.clear();
+		for (int i = 0; i < 3; i++) {
+			driver += names[i] != NULL ? (const char*)names[i] : "";
+			driver += '\n';
+		}
+		createPlaceholder();
+		running.store(true, std::memory_order_release);
+		reader = std::thread(&ShaderCompiler::readLoop, this);
+	}
+public:
+	static ShaderCompiler& instance() {
+		static ShaderCompiler compiler;
+		return compiler;
+	}
+	//Queues a program for building and returns its name straight away. GL thread only.
+	GLuint submit(const char* vertex_file_path, const char* fragment_file_path) {
+		if (!running.load(std::memory_order_acquire))
+			start();
+		Job* job = new Job();
+		job->program = glCreateProgram();
+		job->vertexPath = vertex_file_path;
+		job->fragmentPath = fragment_file_path;
+		job->read = false;
+		job->key = 0;
+		job->binaryFormat = 0;
+		setState(job->program, Pending);
+		outstanding++;
+		while (!toRead.push(job)) {
+			//The reader may itself be waiting for us to take finished reads
+			startCompiles();
+			sleepUntil([&] { return toRead.size() < QUEUE_SIZE || toCompile.size() > 0; });
+		}
+		wakeSleepers();
+		return job->program;
+	}
+	//Call once per frame on the GL thread. Returns true while programs are still being built.
+	bool poll() {
+		if (outstanding == 0)
+			return false;
+		TRACE_SCOPE("shader", "ShaderCompiler::poll");
+		polls++;
+		startCompiles();
+		size_t kept = 0;
+		for (size_t i = 0; i < linking.size(); i++) {
+			bool done;
+			if (parallel) {
+				GLint complete = GL_FALSE;
+				glGetProgramiv(linking[i].job->program, GL_COMPLETION_STATUS_KHR, &complete);
+				done = complete == GL_TRUE;
+			}
+			else
+				done = linking[i].linkedAt != polls; //give the driver at least a frame
+			if (done)
+				finishLink(linking[i]);
+			else
+				linking[kept++] = linking[i];
+		}
+		linking.resize(kept);
+		return outstanding > 0;
+	}
+	//Blocks until everything submitted so far is built. Links are finished at once,
+	//since querying their status waits for the driver, which is the point here.
+	void finish() {
+		TRACE_SCOPE("shader", "ShaderCompiler::finish");
+		while (outstanding > 0) {
+			startCompiles();
+			for (size_t i = 0; i < linking.size(); i++)
+				finishLink(linking[i]);
+			linking.clear();
+			if (outstanding > 0)
+				sleepUntil([&] { return toCompile.size() > 0; });
+		}
+	}
+	bool isReady(GLuint program) {
+		return program < states.size() && states[program] == Ready;
+	}
+	//The program to draw with: itself once built, the placeholder until then
+	GLuint resolve(GLuint program) {
+		if (program >= states.size() || states[program] == Unknown || states[program] == Ready)
+			return program;
+		return placeholder;
+	}
+	int getOutstanding() {
+		return outstanding;
+	}
+	//Programs restored from the binary cache instead of compiled
+	int getRestored() {
+		return restored;
+	}
+	//Where program binaries are kept, or "" to turn the cache off. Set before the first submit().
+	void setCacheDirectory(const char* path) {
+		cacheDirectory = path;
+	}
+	//Stops the worker once pending cache writes are on disk
+	void shutdown() {
+		if (!running.load())
+			return;
+		sleepUntil([&] { return toWrite.size() == 0; });
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			running.store(false);
+		}
+		wake.notify_all();
+		reader.join();
+		glDeleteProgram(placeholder);
+		placeholder = 0;
+	}
+};
+
+//What draw calls pass to glUseProgram
+inline GLuint resolveProgram(GLuint program) {
+	return ShaderCompiler::instance().resolve(program);
+}
@@ -0,0 +1,159 @@
+#pragma once
+// Generated by tools/EmbedShaders.cmake from shaders/. Do not edit.
+
+struct EmbeddedShader {
+	const char* path;
+	const char* source;
+};
+
+constexpr EmbeddedShader EMBEDDED_SHADERS[] = {
+	{ "shaders/circle/fragment.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0.95,0.4,0.1);
+})shader" },
+	{ "shaders/circle/fragment_outline.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(1,1,1);
+})shader" },
+	{ "shaders/circle/vertex.shader", R"shader(#version 330 core
+
+layout(location = 0) in vec3 vertexPosition_modelspace;
+
+void main()
+{
+	gl_Position.xyz = vertexPosition_modelspace;
+  	gl_Position.w = 1.0;
+})shader" },
+	{ "shaders/triangle/black.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0, 0, 0);
+})shader" },
+	{ "shaders/triangle/blue.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0,0,1);
+})shader" },
+	{ "shaders/triangle/brown.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0.474, 0.164, 0.003);
+})shader" },
+	{ "shaders/triangle/brown2.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0.8500, 0.3250, 0.0980);
+})shader" },
+	{ "shaders/triangle/fragment_1.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(1,0,0);
+})shader" },
+	{ "shaders/triangle/fragment_2.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0,0,1);
+})shader" },
+	{ "shaders/triangle/fragment_outline_1.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(1,1,1);
+})shader" },
+	{ "shaders/triangle/fragment_outline_2.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(1,1,1);
+})shader" },
+	{ "shaders/triangle/green.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0,1,0);
+})shader" },
+	{ "shaders/triangle/grey.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0.690, 0.690, 0.690);
+})shader" },
+	{ "shaders/triangle/red.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(1,0,0);
+})shader" },
+	{ "shaders/triangle/vertex_1.shader", R"shader(#version 330 core
+
+layout(location = 0) in vec3 vertexPosition_modelspace;
+
+void main()
+{
+	gl_Position.xyz = vertexPosition_modelspace;
+  	gl_Position.w = 1.0;
+})shader" },
+	{ "shaders/triangle/vertex_2.shader", R"shader(#version 330 core
+
+layout(location = 0) in vec3 vertexPosition_modelspace;
+
+void main()
+{
+	gl_Position.xyz = vertexPosition_modelspace;
+  	gl_Position.w = 1.0;
+})shader" },
+	{ "shaders/triangle/white.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(1,1,1);
+})shader" },
+	{ "shaders/triangle/yellow.shader", R"shader(#version 330 core
+
+out vec3 color;
+
+void main()
+{
+	color = vec3(0.980, 0.925, 0);
+})shader" },
+};
+
+constexpr int EMBEDDED_SHADER_COUNT = 18;
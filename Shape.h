@@ -1,38 +1,50 @@
+#pragma once
 #include <stdio.h>
 #include <stdlib.h>
 #include <glew.h>
 #include <glfw3.h>
 #include <math.h>
+#include <float.h>
+#include <vector>
+#include <utility>
+#include <mutex>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BOUNDS_SSE 1
+#endif
+#include "Shader.h"
+#include "Arena.h"
+#include "GLHandle.h"
+#include "CommandList.h"
+#include "JobSystem.h"
+#include "Affine2.h"
 
-const float PI = 22.0f / 7.0f;
-const float DEG_TO_RAD = PI / 180.0f;
+constexpr float PI = 22.0f / 7.0f;
+constexpr float DEG_TO_RAD = PI / 180.0f;
 
 class Vertex {
 public:
 	GLfloat x, y, z;
-	Vertex(float _x = 0, float _y = 0, float _z = 0) {
-		x = _x;
-		y = _y;
-		z = _z;
-	}
-	Vertex operator- (const Vertex& vertex) {
+	constexpr Vertex(float _x = 0, float _y = 0, float _z = 0) : x(_x), y(_y), z(_z) {}
+	constexpr Vertex operator- (const Vertex& vertex) const {
 		Vertex temp(x, y, z);
 		temp.x -= vertex.x;
 		temp.y -= vertex.y;
 		temp.z -= vertex.z;
 		return temp;
 	}
-	Vertex operator+ (const Vertex& vertex) {
+	constexpr Vertex operator+ (const Vertex& vertex) const {
 		Vertex temp(x, y, z);
 		temp.x += vertex.x;
 		temp.y += vertex.y;
 		temp.z += vertex.z;
 		return temp;
 	}
-	void operator= (const Vertex& vertex) {
+	constexpr Vertex& operator= (const Vertex& vertex) {
 		x = vertex.x;
 		y = vertex.y;
 		z = vertex.z;
+		return *this;
 	}
 	void normalize() {
 		float length = pow(pow(x, 2.0) + pow(y, 2.0) + pow(z, 2.0), 0.5);
@@ -42,6 +54,265 @@ public:
 	}
 };
 
+//Axis-aligned box around a set of points. An empty box has lower above upper,
+//so it overlaps nothing until a point is added.
+class Bounds {
+public:
+	Vertex lower, upper;
+	Bounds() : lower(FLT_MAX, FLT_MAX, FLT_MAX), upper(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+	Bounds(const Vertex& _lower, const Vertex& _upper) : lower(_lower), upper(_upper) {}
+	bool isEmpty() const {
+		return lower.x > upper.x;
+	}
+	void expand(const Vertex& point) {
+		lower.x = point.x < lower.x ? point.x : lower.x;
+		lower.y = point.y < lower.y ? point.y : lower.y;
+		lower.z = point.z < lower.z ? point.z : lower.z;
+		upper.x = point.x > upper.x ? point.x : upper.x;
+		upper.y = point.y > upper.y ? point.y : upper.y;
+		upper.z = point.z > upper.z ? point.z : upper.z;
+	}
+	void expand(const Bounds& other) {
+		if (other.isEmpty())
+			return;
+		expand(other.lower);
+		expand(other.upper);
+	}
+	void translate(const Vertex& movement) {
+		if (isEmpty())
+			return;
+		lower = lower + movement;
+		upper = upper + movement;
+	}
+	//Shapes are drawn flat, so overlap and containment only look at x and y
+	bool overlaps(const Bounds& other) const {
+		return lower.x <= other.upper.x && upper.x >= other.lower.x && lower.y <= other.upper.y && upper.y >= other.lower.y;
+	}
+	bool contains(float x, float y) const {
+		return x >= lower.x && x <= upper.x && y >= lower.y && y <= upper.y;
+	}
+};
+
+//Bounds of many shapes kept as one array per coordinate, so the view test
+//compares four shapes' boxes per instruction instead of walking them one by one.
+//Shapes that track a slot here write their bounds back whenever they move, and
+//the slots written since the last takeChanged() are remembered for refitting.
+//Different slots may be set from different threads at once.
+class BoundsList {
+	std::vector<float> lowerX, lowerY, upperX, upperY;
+	std::vector<int> changed;
+	std::vector<unsigned char> isChanged;
+	std::mutex changedLock;
+public:
+	int size() const {
+		return lowerX.size();
+	}
+	void clear() {
+		lowerX.clear();
+		lowerY.clear();
+		upperX.clear();
+		upperY.clear();
+		changed.clear();
+		isChanged.clear();
+	}
+	void reserve(int count) {
+		lowerX.reserve(count);
+		lowerY.reserve(count);
+		upperX.reserve(count);
+		upperY.reserve(count);
+		isChanged.reserve(count);
+	}
+	//Returns the slot the bounds were stored in
+	int add(const Bounds& bounds) {
+		lowerX.push_back(bounds.lower.x);
+		lowerY.push_back(bounds.lower.y);
+		upperX.push_back(bounds.upper.x);
+		upperY.push_back(bounds.upper.y);
+		isChanged.push_back(0);
+		return size() - 1;
+	}
+	void set(int index, const Bounds& bounds) {
+		lowerX[index] = bounds.lower.x;
+		lowerY[index] = bounds.lower.y;
+		upperX[index] = bounds.upper.x;
+		upperY[index] = bounds.upper.y;
+		if (!isChanged[index]) {
+			isChanged[index] = 1;
+			std::lock_guard<std::mutex> guard(changedLock);
+			changed.push_back(index);
+		}
+	}
+	Bounds get(int index) const {
+		return Bounds(Vertex(lowerX[index], lowerY[index]), Vertex(upperX[index], upperY[index]));
+	}
+	bool contains(int index, float x, float y) const {
+		return x >= lowerX[index] && x <= upperX[index] && y >= lowerY[index] && y <= upperY[index];
+	}
+	bool overlaps(int index, const Bounds& other) const {
+		return lowerX[index] <= other.upper.x && upperX[index] >= other.lower.x && lowerY[index] <= other.upper.y && upperY[index] >= other.lower.y;
+	}
+	//Hands over the slots set since the last call, each once
+	void takeChanged(std::vector<int>& slots) {
+		slots.swap(changed);
+		changed.clear();
+		for (int i = 0; i < slots.size(); i++)
+			isChanged[slots[i]] = 0;
+	}
+	//Appends, in order, the index of every box that overlaps the view in x and y.
+	//Empty boxes never overlap because their lower corner is above their upper one.
+	void cull(const Bounds& view, std::vector<int>& visible) const {
+		cull(view, visible, 0, size());
+	}
+	//Same, for the slots in [first, last) only
+	void cull(const Bounds& view, std::vector<int>& visible, int first, int last) const {
+		int count = last;
+		int i = first;
+#ifdef BOUNDS_SSE
+		__m128 viewLowerX = _mm_set1_ps(view.lower.x), viewLowerY = _mm_set1_ps(view.lower.y);
+		__m128 viewUpperX = _mm_set1_ps(view.upper.x), viewUpperY = _mm_set1_ps(view.upper.y);
+		for (; i + 4 <= count; i += 4) {
+			__m128 inside = _mm_and_ps(
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&lowerX[i]), viewUpperX), _mm_cmpge_ps(_mm_loadu_ps(&upperX[i]), viewLowerX)),
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&lowerY[i]), viewUpperY), _mm_cmpge_ps(_mm_loadu_ps(&upperY[i]), viewLowerY)));
+			int mask = _mm_movemask_ps(inside);
+			if (mask == 0)
+				continue;
+			for (int j = 0; j < 4; j++)
+				if (mask & (1 << j))
+					visible.push_back(i + j);
+		}
+#endif
+		for (; i < count; i++)
+			if (lowerX[i] <= view.upper.x && upperX[i] >= view.lower.x && lowerY[i] <= view.upper.y && upperY[i] >= view.lower.y)
+				visible.push_back(i);
+	}
+};
+
+//Same-sign test of the three edge functions. A triangle collapsed to one point covers nothing.
+inline bool triangleContains(const Vertex& a, const Vertex& b, const Vertex& c, float x, float y) {
+	float e0 = (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+	float e1 = (c.x - b.x) * (y - b.y) - (c.y - b.y) * (x - b.x);
+	float e2 = (a.x - c.x) * (y - c.y) - (a.y - c.y) * (x - c.x);
+	bool sameSide = (e0 >= 0 && e1 >= 0 && e2 >= 0) || (e0 <= 0 && e1 <= 0 && e2 <= 0);
+	return sameSide && (e0 != 0 || e1 != 0 || e2 != 0);
+}
+
+//True if (x, y) falls inside any triangle of a triangle list, in x and y only.
+//Corners are read through indices when there are any. Four triangles are tested
+//per step, so long lists stay cheap enough to test on every click.
+inline bool trianglesContain(const Vertex* points, const GLuint* indices, int count, float x, float y) {
+	int triangles = count / 3;
+	int t = 0;
+#ifdef BOUNDS_SSE
+	__m128 px = _mm_set1_ps(x), py = _mm_set1_ps(y), zero = _mm_setzero_ps();
+	for (; t + 4 <= triangles; t += 4) {
+		const Vertex* corner[4][3];
+		for (int j = 0; j < 4; j++)
+			for (int k = 0; k < 3; k++)
+				corner[j][k] = indices != NULL ? &points[indices[(t + j) * 3 + k]] : &points[(t + j) * 3 + k];
+		__m128 ax = _mm_setr_ps(corner[0][0]->x, corner[1][0]->x, corner[2][0]->x, corner[3][0]->x);
+		__m128 ay = _mm_setr_ps(corner[0][0]->y, corner[1][0]->y, corner[2][0]->y, corner[3][0]->y);
+		__m128 bx = _mm_setr_ps(corner[0][1]->x, corner[1][1]->x, corner[2][1]->x, corner[3][1]->x);
+		__m128 by = _mm_setr_ps(corner[0][1]->y, corner[1][1]->y, corner[2][1]->y, corner[3][1]->y);
+		__m128 cx = _mm_setr_ps(corner[0][2]->x, corner[1][2]->x, corner[2][2]->x, corner[3][2]->x);
+		__m128 cy = _mm_setr_ps(corner[0][2]->y, corner[1][2]->y, corner[2][2]->y, corner[3][2]->y);
+		__m128 e0 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(bx, ax), _mm_sub_ps(py, ay)), _mm_mul_ps(_mm_sub_ps(by, ay), _mm_sub_ps(px, ax)));
+		__m128 e1 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(cx, bx), _mm_sub_ps(py, by)), _mm_mul_ps(_mm_sub_ps(cy, by), _mm_sub_ps(px, bx)));
+		__m128 e2 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(ax, cx), _mm_sub_ps(py, cy)), _mm_mul_ps(_mm_sub_ps(ay, cy), _mm_sub_ps(px, cx)));
+		__m128 sameSide = _mm_or_ps(
+			_mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), zero),
+			_mm_cmple_ps(_mm_max_ps(e0, _mm_max_ps(e1, e2)), zero));
+		__m128 notCollapsed = _mm_or_ps(_mm_cmpneq_ps(e0, zero), _mm_or_ps(_mm_cmpneq_ps(e1, zero), _mm_cmpneq_ps(e2, zero)));
+		if (_mm_movemask_ps(_mm_and_ps(sameSide, notCollapsed)) != 0)
+			return true;
+	}
+#endif
+	for (; t < triangles; t++) {
+		int first = t * 3;
+		if (indices != NULL) {
+			if (triangleContains(points[indices[first]], points[indices[first + 1]], points[indices[first + 2]], x, y))
+				return true;
+		}
+		else if (triangleContains(points[first], points[first + 1], points[first + 2], x, y))
+			return true;
+	}
+	return false;
+}
+
+//Whether the point falls inside the closed outline under rule, looking straight
+//down z. Counts the edges crossing the ray to its right, with their direction.
+inline bool outlineContains(const Vertex* points, int count, FillRule rule, float x, float y) {
+	int winding = 0;
+	for (int i = 0, j = count - 1; i < count; j = i++) {
+		const Vertex& a = points[j];
+		const Vertex& b = points[i];
+		float side = (b.x - a.x) * (y - a.y) - (x - a.x) * (b.y - a.y);
+		if (a.y <= y) {
+			if (b.y > y && side > 0)
+				winding++;
+		}
+		else if (b.y <= y && side < 0)
+			winding--;
+	}
+	return rule == FillRule::EvenOdd ? (winding & 1) != 0 : winding != 0;
+}
+
+//Largest error packing points within bounds into format can introduce, or
+//FLT_MAX when the format cannot hold them at all
+inline float getFormatError(VertexFormat format, const Bounds& bounds) {
+	if (format == VertexFormat::Float3 || bounds.isEmpty())
+		return 0;
+	if (bounds.lower.z != 0 || bounds.upper.z != 0)
+		return FLT_MAX;
+	float x = fabsf(bounds.lower.x) > fabsf(bounds.upper.x) ? fabsf(bounds.lower.x) : fabsf(bounds.upper.x);
+	float y = fabsf(bounds.lower.y) > fabsf(bounds.upper.y) ? fabsf(bounds.lower.y) : fabsf(bounds.upper.y);
+	float largest = x > y ? x : y;
+	switch (format) {
+	case VertexFormat::Half2:
+		return largest > 65504 ? FLT_MAX : largest / 2048; //half a step of 11 significant bits
+	case VertexFormat::Norm16x2:
+		return largest > 1 ? FLT_MAX : 0.5f / 32767;
+	default:
+		return 0;
+	}
+}
+
+//Writes count points into out as format lays them out
+inline void packVertices(VertexFormat format, const Vertex* points, int count, unsigned char* out) {
+	switch (format) {
+	case VertexFormat::Float2: {
+		float* floats = (float*)out;
+		for (int i = 0; i < count; i++) {
+			floats[i * 2] = points[i].x;
+			floats[i * 2 + 1] = points[i].y;
+		}
+		break;
+	}
+	case VertexFormat::Half2: {
+		uint16_t* halves = (uint16_t*)out;
+		for (int i = 0; i < count; i++) {
+			halves[i * 2] = toHalf(points[i].x);
+			halves[i * 2 + 1] = toHalf(points[i].y);
+		}
+		break;
+	}
+	case VertexFormat::Norm16x2: {
+		int16_t* shorts = (int16_t*)out;
+		for (int i = 0; i < count; i++) {
+			//Clamped, since bounds moved by many small steps can drift past the points by a rounding error
+			float x = points[i].x < -1 ? -1 : points[i].x > 1 ? 1 : points[i].x;
+			float y = points[i].y < -1 ? -1 : points[i].y > 1 ? 1 : points[i].y;
+			shorts[i * 2] = (int16_t)(x * 32767 + (x < 0 ? -0.5f : 0.5f));
+			shorts[i * 2 + 1] = (int16_t)(y * 32767 + (y < 0 ? -0.5f : 0.5f));
+		}
+		break;
+	}
+	default:
+		memcpy(out, points, count * sizeof(Vertex));
+		break;
+	}
+}
+
 Vertex getRotationResult(const Vertex& pivot, const Vertex& vector, float angle, Vertex point, bool isEuler = false) {
 	Vertex temp, newPosition;
 	if (isEuler)
@@ -81,17 +352,199 @@ class Shape {
 protected:
 	int pointSize;
 	Vertex* points;
+	bool pointsInArena;
+	bool pointsShared; //points belong to read-only data such as a baked scene
 	Vertex position;
 	Vertex euler[3]; //x, y, z
-	GLuint buffer;
-	GLuint shader, outlineShader;
+	Bounds bounds; //kept up to date by whatever writes the points
+	BoundsList* boundsList; //the scene's copy of the bounds, NULL outside a scene
+	int boundsSlot;
+	GLBuffer buffer;
+	bool needsUpload; //points changed since they were last sent to buffer
+	const GLuint* indices; //optional read-only index data into points, e.g. from a scene file
+	int indexCount;
+	bool indicesOwned, indicesInArena; //indices were made for this shape and go with it
+	GLBuffer indexBuffer;
+	GLuint shader, outlineShader; //shared programs, owned by the shader cache
+	FillRule fill; //anything but Triangles keeps COVER_POINTS spare points after the outline for its cover quad
+	VertexFormat format; //how buffer lays the points out
+
+	void moveFrom(Shape& other) {
+		pointSize = other.pointSize;
+		points = other.points;
+		pointsInArena = other.pointsInArena;
+		pointsShared = other.pointsShared;
+		position = other.position;
+		for (int i = 0; i < 3; i++)
+			euler[i] = other.euler[i];
+		bounds = other.bounds;
+		boundsList = other.boundsList;
+		boundsSlot = other.boundsSlot;
+		buffer = std::move(other.buffer);
+		needsUpload = other.needsUpload;
+		indices = other.indices;
+		indexCount = other.indexCount;
+		indicesOwned = other.indicesOwned;
+		indicesInArena = other.indicesInArena;
+		indexBuffer = std::move(other.indexBuffer);
+		shader = other.shader;
+		outlineShader = other.outlineShader;
+		fill = other.fill;
+		format = other.format;
+		other.pointSize = 0;
+		other.points = NULL;
+		other.boundsList = NULL;
+		other.indicesOwned = false;
+	}
+	void releasePoints() {
+		if (!pointsShared)
+			freeArray(points, getStoredSize(), pointsInArena);
+		points = NULL;
+		releaseIndices();
+	}
+	void releaseIndices() {
+		if (indicesOwned)
+			freeArray(const_cast<GLuint*>(indices), indexCount, indicesInArena);
+		indicesOwned = false;
+	}
+	//Takes ownership of indices made for this shape, such as a triangulation
+	void adoptIndices(GLuint* _indices, int count, bool inArena) {
+		releaseIndices();
+		indices = _indices;
+		indexCount = count;
+		indicesOwned = true;
+		indicesInArena = inArena;
+	}
+	//Points kept in storage, counting the cover quad of a stencil-filled outline
+	int getStoredSize() {
+		return fill == FillRule::Triangles ? pointSize : pointSize + COVER_POINTS;
+	}
+	//Brings the cover quad up to date with the outline's bounds before it is uploaded
+	void writeCover() {
+		if (fill == FillRule::Triangles)
+			return;
+		float z = bounds.lower.z;
+		points[pointSize] = Vertex(bounds.lower.x, bounds.lower.y, z);
+		points[pointSize + 1] = Vertex(bounds.upper.x, bounds.lower.y, z);
+		points[pointSize + 2] = Vertex(bounds.upper.x, bounds.upper.y, z);
+		points[pointSize + 3] = Vertex(bounds.lower.x, bounds.upper.y, z);
+	}
+	void makePointsWritable() {
+		if (!pointsShared)
+			return;
+		Vertex* copy = allocateArray<Vertex>(pointSize, pointsInArena);
+		for (int i = 0; i < pointSize; i++)
+			copy[i] = points[i];
+		points = copy;
+		pointsShared = false;
+		//Now that the points are ours, the buffer may as well be packed
+		chooseVertexFormat(preferredVertexFormat());
+	}
+	void setPoint(int index, const Vertex& point) {
+		points[index] = point;
+		bounds.expand(point);
+	}
+	//For writers that share the work out, each slice collecting bounds of its own
+	void setPoint(int index, const Vertex& point, Bounds& into) {
+		points[index] = point;
+		into.expand(point);
+	}
+	//One quad of a surface of revolution: where its six points go, the angle around
+	//the axis and how far along the profile it starts
+	struct SurfaceSegment {
+		int first;
+		float ring, along;
+	};
+	//Lists a segment instead of writing it. A segment written where an earlier one
+	//was replaces it, as it would overwrite its points.
+	static void planSegment(std::vector<SurfaceSegment>& plan, int first, float ring, float along) {
+		SurfaceSegment segment = { first, ring, along };
+		if (!plan.empty() && plan.back().first == first)
+			plan.back() = segment;
+		else
+			plan.push_back(segment);
+	}
+	//Writes the planned segments that fall within pointSize, spread over the job system
+	template<typename F>
+	void generateSegments(std::vector<SurfaceSegment>& plan, const F& write) {
+		while (!plan.empty() && plan.back().first >= pointSize)
+			plan.pop_back();
+		forEachInParallel(plan.size(), 6, [&](int segment, Bounds& into) {
+			write(plan[segment], into);
+		});
+	}
+	//Shapes with at least this many points are generated and transformed on the job system
+	static const int PARALLEL_POINTS = 1 << 14;
+	//Calls body(i, bounds) for every i in [0, count), each writing pointsEach points,
+	//in slices spread over the job system once PARALLEL_POINTS points are written.
+	//Slices fill bounds of their own, which are then merged into the shape's; the
+	//result is the same however the work was split.
+	template<typename F>
+	void forEachInParallel(int count, int pointsEach, const F& body) {
+		const int SLICE = 1024;
+		if ((long long)count * pointsEach < PARALLEL_POINTS) {
+			for (int i = 0; i < count; i++)
+				body(i, bounds);
+			return;
+		}
+		std::vector<Bounds> sliceBounds((count + SLICE - 1) / SLICE);
+		JobSystem::instance().parallelFor(0, sliceBounds.size(), 1, [&](int first, int last) {
+			for (int slice = first; slice < last; slice++) {
+				int end = (slice + 1) * SLICE < count ? (slice + 1) * SLICE : count;
+				for (int i = slice * SLICE; i < end; i++)
+					body(i, sliceBounds[slice]);
+			}
+		});
+		for (size_t i = 0; i < sliceBounds.size(); i++)
+			bounds.expand(sliceBounds[i]);
+	}
+	void publishBounds() {
+		if (boundsList != NULL)
+			boundsList->set(boundsSlot, bounds);
+	}
 public:
 	Shape(float _x = 0, float _y = 0, float _z = 0) {
+		pointSize = 0;
+		points = NULL;
+		pointsInArena = false;
+		pointsShared = false;
+		boundsList = NULL;
+		boundsSlot = -1;
+		needsUpload = false;
+		indices = NULL;
+		indexCount = 0;
+		indicesOwned = indicesInArena = false;
+		shader = outlineShader = 0;
+		fill = FillRule::Triangles;
+		format = VertexFormat::Float3;
 		position = Vertex(_x, _y, _z);
 		euler[0] = Vertex(1, 0, 0);
 		euler[1] = Vertex(0, 1, 0);
 		euler[2] = Vertex(0, 0, 1);
 	}
+	//Draws straight from read-only vertex data such as a baked scene. The points
+	//are only copied if the shape is later translated or rotated.
+	Shape(const Vertex* sharedPoints, int count, const Vertex& _position) : Shape(_position.x, _position.y, _position.z) {
+		pointSize = count;
+		points = const_cast<Vertex*>(sharedPoints);
+		pointsShared = true;
+		//The one full scan; moves keep the bounds current from here on
+		for (int i = 0; i < count; i++)
+			bounds.expand(sharedPoints[i]);
+	}
+	//Shapes own their points and GL buffer, so they can be moved but not copied
+	Shape(const Shape&) = delete;
+	Shape& operator=(const Shape&) = delete;
+	Shape(Shape&& other) noexcept {
+		moveFrom(other);
+	}
+	Shape& operator=(Shape&& other) noexcept {
+		if (this != &other) {
+			releasePoints();
+			moveFrom(other);
+		}
+		return *this;
+	}
 	Vertex getPosition() {
 		return position;
 	}
@@ -102,7 +555,27 @@ public:
 		return points;
 	}
 	GLuint getBuffer() {
-		return buffer;
+		return buffer.get();
+	}
+	Bounds getBounds() {
+		return bounds;
+	}
+	FillRule getFillRule() {
+		return fill;
+	}
+	//Whether the point falls on one of the shape's triangles, or inside its outline
+	//when that is filled by a rule, looking straight down z
+	bool contains(float x, float y) {
+		if (!bounds.contains(x, y))
+			return false;
+		if (fill != FillRule::Triangles)
+			return outlineContains(points, pointSize, fill, x, y);
+		return trianglesContain(points, indices, indexCount > 0 ? indexCount : pointSize, x, y);
+	}
+	//Keeps a copy of the bounds in list from now on, so it can be culled without touching the shape
+	void trackBounds(BoundsList* list) {
+		boundsList = list;
+		boundsSlot = list->add(bounds);
 	}
 	GLuint getShader() {
 		return shader;
@@ -115,49 +588,172 @@ public:
 			printf("%f, %f, %f\n", points[i].x, points[i].y, points[i].z);
 		}
 	}
+	//Makes the GL buffer, in the preferred vertex format or the nearest one the points
+	//fit. Shared points stay Float3, so they are uploaded as they are, with no packed copy.
 	void initiateBuffer() {
-		glGenBuffers(1, &buffer);
+		chooseVertexFormat(pointsShared ? VertexFormat::Float3 : preferredVertexFormat());
+		buffer = GLBuffer::create();
 		setArrayBuffer();
+		if (indexCount > 0) {
+			indexBuffer = GLBuffer::create();
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.get());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
+		}
+	}
+	//Draws points through the given indices instead of in order. The indices are
+	//not copied and must stay valid for as long as the shape.
+	void setIndices(const GLuint* _indices, int count) {
+		releaseIndices();
+		indices = _indices;
+		indexCount = count;
+	}
+	int getIndexCount() {
+		return indexCount;
 	}
-	void initiateShader(char vertex[], char fragment[]) {
-		shader = LoadShaders(vertex, fragment);
+	const GLuint* getIndices() {
+		return indices;
 	}
-	void initiateOutlineShader(char vertex[], char fragment[]) {
-		outlineShader = LoadShaders(vertex, fragment);
+	void setShader(GLuint program) {
+		shader = program;
+	}
+	void setOutlineShader(GLuint program) {
+		outlineShader = program;
+	}
+	void initiateShader(const char vertex[], const char fragment[]) {
+		shader = LoadShadersCached(vertex, fragment);
+	}
+	void initiateOutlineShader(const char vertex[], const char fragment[]) {
+		outlineShader = LoadShadersCached(vertex, fragment);
+	}
+	VertexFormat getVertexFormat() {
+		return format;
+	}
+	//Lays the buffer out in _format from the next upload on, provided the points
+	//fit it within the precision budget. Otherwise keeps the current format.
+	bool setVertexFormat(VertexFormat _format) {
+		if (getFormatError(_format, bounds) > vertexPrecisionBudget())
+			return false;
+		if (_format != format)
+			needsUpload = true;
+		format = _format;
+		return true;
+	}
+	//Takes preferred if the points fit it, or else the first wider format they do
+	void chooseVertexFormat(VertexFormat preferred) {
+		const VertexFormat widening[] = { VertexFormat::Norm16x2, VertexFormat::Half2, VertexFormat::Float2, VertexFormat::Float3 };
+		int i = 0;
+		while (widening[i] != preferred)
+			i++;
+		while (!setVertexFormat(widening[i])) //Float3 always fits
+			i++;
+	}
+	//The points as the buffer holds them, packed into scratch space unless the
+	//format is Float3. Points moved out of their format widen it first.
+	const void* getBufferData(size_t& size) {
+		writeCover();
+		if (getFormatError(format, bounds) > vertexPrecisionBudget())
+			chooseVertexFormat(format);
+		int count = getStoredSize();
+		size = count * getVertexLayout(format).bytes;
+		if (format == VertexFormat::Float3)
+			return points;
+		static thread_local std::vector<unsigned char> packed;
+		packed.resize(size);
+		packVertices(format, points, count, packed.data());
+		return packed.data();
 	}
 	void setArrayBuffer() {
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, getPointSize() * sizeof(GL_FLOAT) * 3, getPoints(), GL_STATIC_DRAW);
+		size_t size;
+		const void* data = getBufferData(size);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer.get());
+		glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+		needsUpload = false;
 	}
 	void bindBuffer() {
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glVertexAttribPointer(
-			0,                  // attribute 0. No particular reason for 0, but must match the layout in the shader.
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			0            // array buffer offset
-		);
+		if (needsUpload && buffer.get() != 0)
+			setArrayBuffer();
+		glBindBuffer(GL_ARRAY_BUFFER, buffer.get());
+		setVertexAttribute(format);
+		if (indexCount > 0)
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.get());
+	}
+	void drawArrays(GLenum mode) {
+		if (indexCount > 0)
+			glDrawElements(mode, indexCount, GL_UNSIGNED_INT, 0);
+		else
+			glDrawArrays(mode, 0, getPointSize());
 	}
 	void drawPolygon() {
-		glUseProgram(shader);
+		glUseProgram(resolveProgram(shader));
 		bindBuffer();
-		glDrawArrays(GL_TRIANGLES, 0, getPointSize());
+		if (fill != FillRule::Triangles)
+			drawStencilFill(fill, pointSize);
+		else
+			drawArrays(GL_TRIANGLES);
 	}
 	void drawPolyline() {
-		glUseProgram(outlineShader);
+		if (outlineShader == 0)
+			return;
+		glUseProgram(resolveProgram(outlineShader));
 		bindBuffer();
-		glDrawArrays(GL_LINE_SMOOTH, 0, getPointSize());
+		drawArrays(GL_LINE_SMOOTH);
+	}
+	//Write down what drawPolygon and drawPolyline would do, including the upload of
+	//points moved since the last one. No GL calls, so any thread may record.
+	void recordBuffer(CommandList& list) {
+		if (needsUpload && buffer.get() != 0) {
+			size_t size;
+			const void* data = getBufferData(size);
+			list.upload(buffer.get(), -1, 0, data, size, true, format);
+			needsUpload = false;
+		}
+	}
+	void recordPolygon(CommandList& list) {
+		recordBuffer(list);
+		if (fill != FillRule::Triangles) {
+			list.fill(shader, buffer.get(), -1, fill, pointSize, format);
+			return;
+		}
+		list.draw(shader, buffer.get(), -1, indexBuffer.get(), GL_TRIANGLES, indexCount > 0 ? indexCount : pointSize, format);
+	}
+	void recordPolyline(CommandList& list) {
+		if (outlineShader == 0)
+			return;
+		recordBuffer(list);
+		list.draw(outlineShader, buffer.get(), -1, indexBuffer.get(), GL_LINE_SMOOTH, indexCount > 0 ? indexCount : pointSize, format);
+	}
+	//Replaces every point, as when an outline is edited or animated. Storage is
+	//kept while the count stays the same, so reshaping each frame does not allocate
+	//and uploads only the points themselves. Indices no longer apply and are dropped.
+	void reshape(const Vertex* _points, int count) {
+		if (count != pointSize || pointsShared || points == NULL) {
+			releasePoints();
+			pointsShared = false;
+			pointSize = count;
+			points = allocateArray<Vertex>(getStoredSize(), pointsInArena);
+		}
+		setIndices(NULL, 0);
+		bounds = Bounds();
+		for (int i = 0; i < count; i++)
+			setPoint(i, _points[i]);
+		publishBounds();
+		needsUpload = true;
 	}
 	void rotate(Vertex pivot, Vertex vector, float angle)
 	{
 		angle = angle * DEG_TO_RAD;
-
-		//Rotate all the points
-		for (int i = 0; i < pointSize; i++) {
-			points[i] = getRotationResult(pivot, vector, angle, points[i]);
+		//Turning about z keeps a flat shape flat, which the plane's transform does for far less
+		if (vector.x == 0 && vector.y == 0 && fabsf(vector.z) == 1) {
+			transform(Affine2::rotation(vector.z * angle, Vec2(pivot.x, pivot.y)));
+			return;
 		}
+		makePointsWritable();
+
+		//Rotate all the points, re-bounding them as they go
+		bounds = Bounds();
+		forEachInParallel(pointSize, 1, [&](int i, Bounds& into) {
+			setPoint(i, getRotationResult(pivot, vector, angle, points[i]), into);
+		});
 		//Rotate the euler direction
 		for (int i = 0; i < 3; i++)
 		{
@@ -166,45 +762,87 @@ public:
 		}
 
 		position = getRotationResult(pivot, vector, angle, position);
-		setArrayBuffer();
+		publishBounds();
+		needsUpload = true;
 	}
-	void translate(const Vertex& movement) {
-		for (int i = 0; i < pointSize; i++) {
-			points[i] = points[i] + movement;
+	//Moves every point by a transform of the plane, leaving z as it is. This is
+	//the 2D path: four multiplies and four adds a point, where a 3D rotation takes
+	//several times that. The euler directions turn with the shape.
+	void transform(const Affine2& matrix) {
+		if (matrix.isTranslation()) {
+			translate(Vertex(matrix.tx, matrix.ty));
+			return;
+		}
+		makePointsWritable();
+		bounds = Bounds();
+		forEachInParallel(pointSize, 1, [&](int i, Bounds& into) {
+			Vec2 moved = matrix.apply(points[i].x, points[i].y);
+			setPoint(i, Vertex(moved.x, moved.y, points[i].z), into);
+		});
+		for (int i = 0; i < 3; i++) {
+			Vec2 turned = matrix.applyLinear(euler[i].x, euler[i].y);
+			euler[i] = Vertex(turned.x, turned.y, euler[i].z);
+			euler[i].normalize();
 		}
+		Vec2 moved = matrix.apply(position.x, position.y);
+		position = Vertex(moved.x, moved.y, position.z);
+		publishBounds();
+		needsUpload = true;
+	}
+	void translate(const Vertex& movement) {
+		makePointsWritable();
+		JobSystem::instance().parallelFor(0, pointSize, PARALLEL_POINTS, [&](int first, int last) {
+			for (int i = first; i < last; i++)
+				points[i] = points[i] + movement;
+		});
+		bounds.translate(movement);
+		publishBounds();
 		position = position + movement;
-		setArrayBuffer();
+		needsUpload = true; //sent with the next draw, however many moves come first
 	}
 	Vertex getEuler(int index) {
 		return euler[index];
 	}
+	void setEuler(int index, const Vertex& direction) {
+		euler[index] = direction;
+	}
 	void resetEuler() {
 		euler[0] = Vertex(1, 0, 0);
 		euler[1] = Vertex(0, 1, 0);
 		euler[2] = Vertex(0, 0, 1);
 	}
-	~Shape() {
-		delete points;
-		glDeleteBuffers(1, &buffer);
+	virtual ~Shape() {
+		releasePoints();
 	}
 };
 
+bool tooClose(const std::vector<Shape*>& dots, float _x, float _y) {
+	bool result = false;
+	for (int i = 0; i < dots.size() && !result; i++) {
+		if (fabs(_x - dots[i]->getPosition().x) < 0.002 && fabs(_y - dots[i]->getPosition().y) < 0.002)
+			result = true;
+	}
+	return result;
+}
+
 class Triangle : public Shape {
 public:
 	Triangle() {
 		pointSize = 3;
-		points = new Vertex[pointSize];
+		points = allocateArray<Vertex>(pointSize, pointsInArena);
 	}
 	Triangle(Vertex _points[3], float _x = 0, float _y = 0, float _z = 0) : Shape(_x, _y, _z) {
 		pointSize = 3;
-		points = new Vertex[pointSize];
+		points = allocateArray<Vertex>(pointSize, pointsInArena);
 		for (int i = 0; i < pointSize; i++) {
-			points[i] = _points[i];
+			setPoint(i, _points[i]);
 		}
 	}
 	void setPoints(const Vertex pts[3]) {
+		bounds = Bounds();
 		for (int i = 0; i < 3; i++)
-			points[i] = pts[i];
+			setPoint(i, pts[i]);
+		publishBounds();
 	}
 	void setPosition(const Vertex& _position) {
 		position = _position;
@@ -212,51 +850,117 @@ public:
 
 };
 
+//Taylor series sine, usable in constant expressions where <math.h> is not. Circles
+//built at run time use it too, so they match the ones baked at compile time.
+constexpr double bakedSin(double angle) {
+	const double HALF_TURN = 3.141592653589793;
+	while (angle > HALF_TURN)
+		angle -= 2 * HALF_TURN;
+	while (angle < -HALF_TURN)
+		angle += 2 * HALF_TURN;
+	//sin(x) = sin(pi - x) brings the angle within pi/2, where six terms are exact to about 1e-9
+	if (angle > HALF_TURN / 2)
+		angle = HALF_TURN - angle;
+	else if (angle < -HALF_TURN / 2)
+		angle = -HALF_TURN - angle;
+	double square = angle * angle, sum = 1;
+	for (int n = 6; n >= 1; n--)
+		sum = 1 - square * (1.0 / ((2 * n) * (2 * n + 1))) * sum;
+	return angle * sum;
+}
+
+constexpr double bakedCos(double angle) {
+	return bakedSin(angle + 1.5707963267948966);
+}
+
+//The three points of the circle segment starting at angle: on the rim, the centre,
+//and on the rim a step further, found by turning the first by the step's cosine and sine
+constexpr void circleSegment(float angle, double stepCos, double stepSin, float radius, const Vertex& position, Vertex* out) {
+	double cosine = bakedCos(angle), sine = bakedSin(angle);
+	double nextCosine = cosine * stepCos - sine * stepSin, nextSine = sine * stepCos + cosine * stepSin;
+	out[0] = Vertex((float)(cosine * radius) + position.x, (float)(sine * radius) + position.y, 0);
+	out[1] = position;
+	out[2] = Vertex((float)(nextCosine * radius) + position.x, (float)(nextSine * radius) + position.y, 0);
+}
+
+//Calls segment(j, angle) for each segment of a circle of pointSize points, j being
+//its first point. The angle is summed one float step at a time, so every caller
+//gets the same angles.
+template<typename F>
+constexpr void walkCircle(int pointSize, float step, float scale, F& segment) {
+	float i = -PI;
+	float end = i + 2 * PI * scale;
+	for (int j = 0; i <= end && j < pointSize; i += step, j += 3)
+		segment(j, i);
+}
+
 class Circle : public Shape {
 	float radius;
 	float step;
+	double stepCos, stepSin;
 	float scale; //max = 1, min = 0; -> 0.5 means half of a circle
 public:
 	Circle(float _x = 0, float _y = 0, float _z = 0, int _pointSize = 1, float _radius = 1.0, float _scale = 1.0) : Shape(_x, _y, _z) {
 		scale = _scale;
 		pointSize = _pointSize * 3;
-		points = new Vertex[pointSize];
+		points = allocateArray<Vertex>(pointSize, pointsInArena);
 		radius = _radius;
 		step = 2 * PI * scale / _pointSize;
+		stepCos = bakedCos(step);
+		stepSin = bakedSin(step);
 		Generate();
 	}
+	void setSegment(int j, float i, Bounds& into) {
+		Vertex segment[3];
+		circleSegment(i, stepCos, stepSin, radius, position, segment);
+		for (int k = 0; k < 3; k++)
+			setPoint(j + k, segment[k], into);
+	}
 	void Generate() {
-		float i = -PI;
-		float end = i + 2 * PI * scale;
-		int j = 0;
-		for (; i <= end; i += step, j += 3)
-		{
-			float x = cos(i) * radius + position.x;
-			float y = sin(i) * radius + position.y;
-			float z = 0;
-
-			float next_x = cos(i + step) * radius + position.x;
-			float next_y = sin(i + step) * radius + position.y;
-			float next_z = 0;
-
-			points[j] = Vertex(x, y, z);
-			points[j + 1] = position; //0,0,0
-			points[j + 2] = Vertex(next_x, next_y, next_z);
+		TRACE_SCOPE("scene", "Circle::Generate");
+		bounds = Bounds();
+		if (pointSize < PARALLEL_POINTS) {
+			auto write = [&](int j, float i) { setSegment(j, i, bounds); };
+			walkCircle(pointSize, step, scale, write);
 		}
+		else {
+			//The walk only collects the angles; the points are then written in parallel
+			std::vector<float> angles;
+			auto collect = [&](int, float i) { angles.push_back(i); };
+			walkCircle(pointSize, step, scale, collect);
+			forEachInParallel(angles.size(), 3, [&](int segment, Bounds& into) {
+				setSegment(segment * 3, angles[segment], into);
+			});
+		}
+		publishBounds();
 	}
 };
 
 class Box {
 	Vertex position;
 	Triangle* triangles;
+	bool trianglesInArena;
 	float length, width, height;
+	Bounds bounds; //union of the triangles' bounds
+	BoundsList* boundsList;
+	int boundsSlot;
+
+	void updateBounds() {
+		bounds = Bounds();
+		for (int i = 0; i < 12; i++)
+			bounds.expand(triangles[i].getBounds());
+		if (boundsList != NULL)
+			boundsList->set(boundsSlot, bounds);
+	}
 public:
 	Box(float _x = 0, float _y = 0, float _z = 0, float _length = 0.3, float _width = 0.3, float _height = 0.3) {
 		position = Vertex(_x, _y, _z);
+		boundsList = NULL;
+		boundsSlot = -1;
 		length = _length;
 		width = _width;
 		height = _height;
-		triangles = new Triangle[12];
+		triangles = allocateArray<Triangle>(12, trianglesInArena);
 		Vertex pts[12][3] = {
 			{//Front - 1
 				Vertex(position.x - length / 2, position.y + height / 2, position.z - width / 2),
@@ -324,19 +1028,59 @@ public:
 			triangles[i].setPoints(pts[i]);
 			triangles[i].setPosition(position);
 		}
+		updateBounds();
+	}
+	Box(const Box&) = delete;
+	Box& operator=(const Box&) = delete;
+	Box(Box&& other) noexcept {
+		position = other.position;
+		triangles = other.triangles;
+		trianglesInArena = other.trianglesInArena;
+		length = other.length;
+		width = other.width;
+		height = other.height;
+		bounds = other.bounds;
+		boundsList = other.boundsList;
+		boundsSlot = other.boundsSlot;
+		other.triangles = NULL;
+		other.boundsList = NULL;
+	}
+	~Box() {
+		freeArray(triangles, 12, trianglesInArena);
 	}
 	Vertex getPosition() {
 		return position;
 	}
+	int getPointSize() {
+		return 12 * 3;
+	}
+	Triangle* getTriangle(int index) {
+		return &triangles[index];
+	}
+	Bounds getBounds() {
+		return bounds;
+	}
+	void trackBounds(BoundsList* list) {
+		boundsList = list;
+		boundsSlot = list->add(bounds);
+	}
+	bool contains(float x, float y) {
+		if (!bounds.contains(x, y))
+			return false;
+		for (int i = 0; i < 12; i++)
+			if (triangles[i].contains(x, y))
+				return true;
+		return false;
+	}
 	void initiateBuffer() {
 		for (int i = 0; i < 12; i++)
 			triangles[i].initiateBuffer();
 	}
-	void initiateShader(char vertex[], char fragment[]) {
+	void initiateShader(const char vertex[], const char fragment[]) {
 		for (int i = 0; i < 12; i++)
 			triangles[i].initiateShader(vertex, fragment);
 	}
-	void initiateOutlineShader(char vertex[], char fragment[]) {
+	void initiateOutlineShader(const char vertex[], const char fragment[]) {
 		for (int i = 0; i < 12; i++)
 			triangles[i].initiateOutlineShader(vertex, fragment);
 	}
@@ -348,9 +1092,24 @@ public:
 		for (int i = 0; i < 12; i++)
 			triangles[i].drawPolyline();
 	}
+	void recordPolygon(CommandList& list) {
+		for (int i = 0; i < 12; i++)
+			triangles[i].recordPolygon(list);
+	}
+	void recordPolyline(CommandList& list) {
+		for (int i = 0; i < 12; i++)
+			triangles[i].recordPolyline(list);
+	}
 	void rotate(const Vertex& pivot, const Vertex& vector, float angle) {
 		for (int i = 0; i < 12; i++)
 			triangles[i].rotate(pivot, vector, angle);
+		updateBounds();
+	}
+	void translate(const Vertex& movement) {
+		for (int i = 0; i < 12; i++)
+			triangles[i].translate(movement);
+		position = position + movement;
+		updateBounds();
 	}
 };
 
@@ -365,44 +1124,60 @@ public:
 		smoothing = _smoothing;
 		radius = _radius;
 		pointSize = _pointSize * _smoothing * 3.0f * 2.0f;
-		points = new Vertex[pointSize];
+		points = allocateArray<Vertex>(pointSize, pointsInArena);
 		step = 2.0 * PI * scale / (float)_pointSize;
 		stepInner = PI / (float)smoothing;
 		generate();
 	}
+	void setSegment(int l, float i, float k, Bounds& into) {
+		float cur_x = cos(k) * radius.x + position.x;
+		float cur_y = sin(k) * radius.y + position.y;
+		float cur_z = position.z;
+
+		float next_x = cos(k + stepInner) * radius.x + position.x;
+		float next_y = sin(k + stepInner) * radius.y + position.y;
+		float next_z = position.z;
+
+		setPoint(l, getRotationResult(position, Vertex(1, 0, 0), i, Vertex(cur_x, cur_y, cur_z)), into);
+		setPoint(l + 1, getRotationResult(position, Vertex(1, 0, 0), i, Vertex(next_x, next_y, next_z)), into);
+		setPoint(l + 2, getRotationResult(position, Vertex(1, 0, 0), i + step, Vertex(cur_x, cur_y, cur_z)), into);
+		setPoint(l + 3, getRotationResult(position, Vertex(1, 0, 0), i, Vertex(next_x, next_y, next_z)), into);
+		setPoint(l + 4, getRotationResult(position, Vertex(1, 0, 0), i + step, Vertex(cur_x, cur_y, cur_z)), into);
+		setPoint(l + 5, getRotationResult(position, Vertex(1, 0, 0), i + step, Vertex(next_x, next_y, next_z)), into);
+	}
 	void generate() {
+		TRACE_SCOPE("scene", "Ovaloid::generate");
+		bounds = Bounds();
+		bool parallel = pointSize >= PARALLEL_POINTS;
+		std::vector<SurfaceSegment> plan;
 		float i = -PI;
 		float end = i + 2.0 * PI * scale;
 		int l = 0, j = 1;
 		for (; i < end && l < pointSize; i += step, j++) {
 			float k = -PI;
 			float endInner = k + PI;
-			for (; k < endInner; k += stepInner, l += 6) {
-				float cur_x = cos(k) * radius.x + position.x;
-				float cur_y = sin(k) * radius.y + position.y;
-				float cur_z = position.z;
-
-				float next_x = cos(k + stepInner) * radius.x + position.x;
-				float next_y = sin(k + stepInner) * radius.y + position.y;
-				float next_z = position.z;
-
-				points[l] = getRotationResult(position, Vertex(1, 0, 0), i, Vertex(cur_x, cur_y, cur_z));
-				points[l + 1] = getRotationResult(position, Vertex(1, 0, 0), i, Vertex(next_x, next_y, next_z));
-				points[l + 2] = getRotationResult(position, Vertex(1, 0, 0), i + step, Vertex(cur_x, cur_y, cur_z));
-				points[l + 3] = getRotationResult(position, Vertex(1, 0, 0), i, Vertex(next_x, next_y, next_z));
-				points[l + 4] = getRotationResult(position, Vertex(1, 0, 0), i + step, Vertex(cur_x, cur_y, cur_z));
-				points[l + 5] = getRotationResult(position, Vertex(1, 0, 0), i + step, Vertex(next_x, next_y, next_z));
+			for (; k < endInner && l < pointSize; k += stepInner, l += 6) {
+				if (parallel)
+					planSegment(plan, l, i, k);
+				else
+					setSegment(l, i, k, bounds);
 			}
 			if (!(l <= 6 * smoothing * j))
 				l = l - 6;
 		}
 		pointSize = l;
+		if (parallel)
+			generateSegments(plan, [&](const SurfaceSegment& segment, Bounds& into) {
+				setSegment(segment.first, segment.ring, segment.along, into);
+			});
+		publishBounds();
 	}
 };
 
 
 class Vase : public Shape {
 	Vertex* pts;
+	bool controlInArena;
 	int ptsCount;
 	float* berzierConst, step, stepInner;
 	float scale;
@@ -412,65 +1187,107 @@ public:
 		scale = _scale;
 		smoothing = _smoothing;
 		pointSize = _pointSize * smoothing * 3.0 * 2.0;
-		points = new Vertex[pointSize];
+		points = allocateArray<Vertex>(pointSize, pointsInArena);
 		step = 2.0 * PI * scale / (float)_pointSize;
 		stepInner = 1.0 / (float)(smoothing - 1);
 
 		//Control points
 		ptsCount = _ptsCount;
-		pts = new Vertex[ptsCount];
+		pts = allocateArray<Vertex>(ptsCount, controlInArena);
 		for (int i = 0; i < ptsCount; i++)
 			pts[i] = _pts[i] + position;
-		berzierConst = new float[ptsCount];
+		berzierConst = allocateArray<float>(ptsCount, controlInArena);
 		for (int i = 0; i < ptsCount; i++)
 			berzierConst[i] = getPascal(ptsCount - 1, i);
 		generate();
 	}
+	Vase(Vase&& other) noexcept : Shape(std::move(other)) {
+		pts = other.pts;
+		ptsCount = other.ptsCount;
+		controlInArena = other.controlInArena;
+		berzierConst = other.berzierConst;
+		step = other.step;
+		stepInner = other.stepInner;
+		scale = other.scale;
+		smoothing = other.smoothing;
+		other.pts = NULL;
+		other.berzierConst = NULL;
+	}
+	~Vase() {
+		freeArray(pts, ptsCount, controlInArena);
+		freeArray(berzierConst, ptsCount, controlInArena);
+	}
+	void setSegment(int l, float i, float k, Bounds& into) {
+		float cur_x = 0, cur_y = 0, cur_z = 0;
+		for (int a = 0; a < ptsCount; a++) {
+			float multiplier = pow(1.0 - k, ptsCount - a - 1) * pow(k, a) * berzierConst[a];
+			cur_x += multiplier * pts[a].x;
+			cur_y += multiplier * pts[a].y;
+			cur_z += multiplier * pts[a].z;
+		}
+
+		float next_x = 0, next_y = 0, next_z = 0;
+		for (int a = 0; a < ptsCount; a++) {
+			float multiplier = pow(1.0 - (k + stepInner), ptsCount - a - 1) * pow((k + stepInner), a) * berzierConst[a];
+			next_x += multiplier * pts[a].x;
+			next_y += multiplier * pts[a].y;
+			next_z += multiplier * pts[a].z;
+		}
+
+		setPoint(l, getRotationResult(position, Vertex(0, 1, 0), i, Vertex(cur_x, cur_y, cur_z)), into);
+		setPoint(l + 1, getRotationResult(position, Vertex(0, 1, 0), i, Vertex(next_x, next_y, next_z)), into);
+		setPoint(l + 2, getRotationResult(position, Vertex(0, 1, 0), i + step, Vertex(cur_x, cur_y, cur_z)), into);
+		setPoint(l + 3, getRotationResult(position, Vertex(0, 1, 0), i, Vertex(next_x, next_y, next_z)), into);
+		setPoint(l + 4, getRotationResult(position, Vertex(0, 1, 0), i + step, Vertex(cur_x, cur_y, cur_z)), into);
+		setPoint(l + 5, getRotationResult(position, Vertex(0, 1, 0), i + step, Vertex(next_x, next_y, next_z)), into);
+	}
 	void generate() {
+		TRACE_SCOPE("scene", "Vase::generate");
+		bounds = Bounds();
+		bool parallel = pointSize >= PARALLEL_POINTS;
+		std::vector<SurfaceSegment> plan;
 		float i = -PI;
 		float end = i + 2.0 * PI * scale;
 		int l = 0, j = 1;
-		for (int; i < end && l < pointSize; i += step, j++) {
+		for (; i < end && l < pointSize; i += step, j++) {
 			float k = 0;
 			float endInner = 1.0;
-			for (; endInner; k += stepInner, l += 6) {
-				float cur_x = 0, cur_y = 0, cur_z = 0;
-				for (int a = 0; a < ptsCount; a++) {
-					float multiplier = pow(1.0 - k, ptsCount - a - 1) * pow(k, a) * berzierConst[a];
-					cur_x += multiplier * pts[a].x;
-					cur_y += multiplier * pts[a].y;
-					cur_z += multiplier * pts[a].z;
-				}
-
-				float next_x = 0, next_y = 0, next_z = 0;
-				for (int a = 0; a < ptsCount; a++) {
-					float multiplier = pow(1.0 - (k + stepInner), ptsCount - a - 1) * pow((k + stepInner), a) * berzierConst[a];
-					next_x += multiplier * pts[a].x;
-					next_y += multiplier * pts[a].y;
-					next_z += multiplier * pts[a].z;
-				}
-
-				points[l] = getRotationResult(position, Vertex(0, 1, 0), i, Vertex(cur_x, cur_y, cur_z));
-				points[l + 1] = getRotationResult(position, Vertex(0, 1, 0), i, Vertex(next_x, next_y, next_z));
-				points[l + 2] = getRotationResult(position, Vertex(0, 1, 0), i + step, Vertex(cur_x, cur_y, cur_z));
-				points[l + 3] = getRotationResult(position, Vertex(0, 1, 0), i, Vertex(next_x, next_y, next_z));
-				points[l + 4] = getRotationResult(position, Vertex(0, 1, 0), i + step, Vertex(cur_x, cur_y, cur_z));
-				points[l + 5] = getRotationResult(position, Vertex(0, 1, 0), i + step, Vertex(next_x, next_y, next_z));
+			for (; k < endInner && l < pointSize; k += stepInner, l += 6) {
+				if (parallel)
+					planSegment(plan, l, i, k);
+				else
+					setSegment(l, i, k, bounds);
 			}
 			if (!(l <= 6 * smoothing * j))
 				l = l - 6;
 		}
 		pointSize = l;
+		if (parallel)
+			generateSegments(plan, [&](const SurfaceSegment& segment, Bounds& into) {
+				setSegment(segment.first, segment.ring, segment.along, into);
+			});
+		publishBounds();
 	}
 };
 
+//A shape and the hierarchies hanging off it. Moves reach every child, with the
+//children's subtrees transformed in parallel, so no shape may appear twice.
 class Hierarchy {
 	Shape* parent;
 	Hierarchy** children;
 	int childCount;
+
+	template<typename F>
+	void forEachChild(const F& visit) {
+		JobSystem::instance().parallelFor(0, childCount, 1, [&](int first, int last) {
+			for (int i = first; i < last; i++)
+				visit(children[i]);
+		});
+	}
 public:
 	Hierarchy(Shape* _parent = NULL) {
 		parent = _parent;
+		children = NULL;
 		childCount = 0;
 	}
 	void setParent(Shape* _parent) {
@@ -486,13 +1303,21 @@ public:
 	}
 	void translate(const Vertex& movement) {
 		parent->translate(movement);
-		for (int i = 0; i < childCount; i++)
-			children[i]->translate(movement);
+		forEachChild([&](Hierarchy* child) {
+			child->translate(movement);
+		});
 	}
 	void rotate(const Vertex& pivot, const Vertex& vector, float angle) {
 		parent->rotate(pivot, vector, angle);
-		for (int i = 0; i < childCount; i++)
-			children[i]->rotate(pivot, vector, angle);
+		forEachChild([&](Hierarchy* child) {
+			child->rotate(pivot, vector, angle);
+		});
+	}
+	void transform(const Affine2& matrix) {
+		parent->transform(matrix);
+		forEachChild([&](Hierarchy* child) {
+			child->transform(matrix);
+		});
 	}
 	void drawPolygon() {
 		parent->drawPolygon();
@@ -509,12 +1334,12 @@ public:
 		for (int i = 0; i < childCount; i++)
 			children[i]->initiateBuffer();
 	}
-	void initiateShader(char vertex[], char fragment[]) {
+	void initiateShader(const char vertex[], const char fragment[]) {
 		parent->initiateShader(vertex, fragment);
 		for (int i = 0; i < childCount; i++)
 			children[i]->initiateShader(vertex, fragment);
 	}
-	void initiateOutlineShader(char vertex[], char fragment[]) {
+	void initiateOutlineShader(const char vertex[], const char fragment[]) {
 		parent->initiateOutlineShader(vertex, fragment);
 		for (int i = 0; i < childCount; i++)
 			children[i]->initiateOutlineShader(vertex, fragment);
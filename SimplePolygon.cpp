@@ -4,37 +4,55 @@
 #include <math.h>
 #include <vector>
 #include <glfw3.h>
+#include "Logger.h"
+#include "Trace.h"
 #include "Shader.h"
 #include "Shape.h"
+#include "Scene.h"
+#include "SceneGenerator.h"
+#include "Input.h"
+#include "Stroke.h"
+#include "BakedScene.h"
+#include "SceneFile.h"
+#include "SceneStreamer.h"
+#include "Damage.h"
+#include "FramePacer.h"
+#include "UpdateWorker.h"
+#include "JobSystem.h"
 
-Shape** shapes;
-vector<Shape*> dot;
-bool isClicked = false;
-const int SHAPE_COUNT = 29;
+SceneFile sceneFile; //declared before scene so it outlives the shapes mapped from it
+SceneStreamer sceneStreamer(sceneFile);
+Scene scene;
+Stroke* currentStroke = NULL;
+SceneItem selected; //what a ctrl-drag is moving, index -1 when nothing is
+Vertex dragLast, dragTo; //where the selection was last moved to, and where the cursor has got to since
+bool dragPending = false;
+DamageTracker damage; //what has to be redrawn in on-demand mode
+RetainedFrame retainedFrame;
+FramePacer framePacer;
+UpdateWorker updateWorker; //input and draw recording, when --threaded
+vector<GLBuffer> commandBuffers; //the GL side of buffers that command lists name by slot
+bool threaded = false;
+GLuint strokeShader;
+InputQueue inputQueue;
+StrokeResampler strokeResampler(0.004f);
+vector<Vertex> strokeSamples;
+int lassoShape = -1; //index of the StencilPolygon a shift-drag outlines
+bool lassoActive = false;
+StrokeResampler lassoResampler(0.01f);
+vector<Vertex> lassoOutline;
+const int SHAPE_COUNT = BAKED_SHAPE_COUNT;
 int WINDOW_WIDTH = 1200, WINDOW_HEIGHT = 1000;
 
 GLFWwindow* window; // (In the accompanying source code, this variable is global for simplicity)
-GLuint VertexArrayID;
-bool tooClose(float _x, float _y) {
-	bool result = false;
-	for (int i = 0; i < dot.size() && !result; i++) {
-		if (abs(_x - dot[i]->getPosition().x) < 0.002 && abs(_y - dot[i]->getPosition().y) < 0.002)
-			result = true;
-	}
-	return result;
-}
+GLVertexArray vertexArray;
 void mouseMoveEvent(GLFWwindow* window, double x, double y)
 {
 	double mod_x = (float)(x - (WINDOW_WIDTH / 2)) / (float)(WINDOW_WIDTH / 2);
 	double mod_y = (float)(WINDOW_HEIGHT - y - (WINDOW_HEIGHT / 2)) / (float)(WINDOW_HEIGHT / 2);
-	printf("X : %f, Y : %f\n", mod_x, mod_y);
-	if (isClicked && !tooClose(mod_x, mod_y)) {
-		Shape* newDot = new Circle(mod_x, mod_y, 0, 100, 0.005, 1);
-		newDot->initiateBuffer();
-		char dotShader[2][100] = { {"shaders/circle/vertex.shader"}, {"shaders/circle/fragment.shader"} };
-		newDot->initiateShader(dotShader[0], dotShader[1]);
-		dot.push_back(newDot);
-	}
+	LOG_TRACE(LogCategory::Input, "X : %f, Y : %f", mod_x, mod_y);
+	if (!inputQueue.push(InputEvent(InputEventType::Move, mod_x, mod_y)))
+		LOG_WARN(LogCategory::Input, "Input queue full, cursor sample dropped");
 }
 
 void mouseClickEvent(GLFWwindow* window, int button, int action, int mods)
@@ -48,31 +66,141 @@ void mouseClickEvent(GLFWwindow* window, int button, int action, int mods)
 		double mod_y = (float)(WINDOW_HEIGHT - y - (WINDOW_HEIGHT / 2)) / (float)(WINDOW_HEIGHT / 2);
 		if (action == GLFW_PRESS)
 		{
-			printf("LEFT CLICK ON : (%lf, %lf)\n", mod_x, mod_y);
-			isClicked = true;
+			LOG_DEBUG(LogCategory::Input, "LEFT CLICK ON : (%lf, %lf)", mod_x, mod_y);
+			if (!inputQueue.push(InputEvent(InputEventType::Press, mod_x, mod_y, button, mods)))
+				LOG_WARN(LogCategory::Input, "Input queue full, button press dropped");
 		}
 		else if (action == GLFW_RELEASE)
 		{
-			printf("LEFT RELEASE ON : (%lf, %lf)\n", mod_x, mod_y);
-			isClicked = false;
+			LOG_DEBUG(LogCategory::Input, "LEFT RELEASE ON : (%lf, %lf)", mod_x, mod_y);
+			if (!inputQueue.push(InputEvent(InputEventType::Release, mod_x, mod_y, button, mods)))
+				LOG_WARN(LogCategory::Input, "Input queue full, button release dropped");
+		}
+	}
+}
+
+//Moves the selection to the last cursor sample queued for it, once however many arrived
+void applyDrag() {
+	if (!dragPending)
+		return;
+	dragPending = false;
+	damage.add(scene.getBounds(selected));
+	scene.translate(selected, dragTo - dragLast);
+	damage.add(scene.getBounds(selected));
+	dragLast = dragTo;
+}
+
+//Ctrl-click picks the topmost shape under the cursor, and dragging moves it
+bool processSelection(const InputEvent& event) {
+	if (event.type == InputEventType::Press && (event.mods & GLFW_MOD_CONTROL)) {
+		applyDrag();
+		if (scene.pick(event.x, event.y, selected)) {
+			LOG_DEBUG(LogCategory::Input, "Picked %s %d", selected.type == SceneItemType::Shape ? "shape" : selected.type == SceneItemType::Box ? "box" : "stroke", selected.index);
+			dragLast = Vertex(event.x, event.y);
 		}
+		return true;
+	}
+	if (selected.index < 0)
+		return false;
+	dragTo = Vertex(event.x, event.y);
+	dragPending = true;
+	if (event.type == InputEventType::Release) {
+		applyDrag();
+		selected = SceneItem();
+	}
+	return true;
+}
+
+//Shift-drag outlines the lasso, resampled like a stroke. Returns true if the event was the lasso's.
+bool processLasso(const InputEvent& event) {
+	if (event.type == InputEventType::Press && (event.mods & GLFW_MOD_SHIFT) && lassoShape >= 0) {
+		lassoActive = true;
+		lassoOutline.clear();
+		lassoResampler.begin(event.x, event.y, lassoOutline);
+		return true;
+	}
+	if (!lassoActive)
+		return false;
+	if (event.type == InputEventType::Release) {
+		lassoResampler.end(event.x, event.y, lassoOutline);
+		lassoActive = false;
+	}
+	else
+		lassoResampler.add(event.x, event.y, lassoOutline);
+	return true;
+}
+
+//Drains everything the callbacks queued since the last frame. Cursor samples are
+//resampled along the drag path and appended to the stroke being drawn; a dragged
+//selection and the lasso only take the frame's last position.
+void processInput() {
+	TRACE_SCOPE("render", "processInput");
+	InputEvent event;
+	bool lassoChanged = false;
+	while (inputQueue.pop(event)) {
+		if (processSelection(event))
+			continue;
+		if (processLasso(event)) {
+			lassoChanged = true;
+			continue;
+		}
+		strokeSamples.clear();
+		if (event.type == InputEventType::Press) {
+			currentStroke = &scene.create<Stroke>(0.01f);
+			currentStroke->setShader(strokeShader);
+			strokeResampler.begin(event.x, event.y, strokeSamples);
+		}
+		else if (event.type == InputEventType::Release)
+			strokeResampler.end(event.x, event.y, strokeSamples);
+		else if (strokeResampler.isActive())
+			strokeResampler.add(event.x, event.y, strokeSamples);
+
+		if (currentStroke != NULL) {
+			int firstNew = currentStroke->getPointSize();
+			for (int i = 0; i < strokeSamples.size(); i++)
+				currentStroke->addPoint(strokeSamples[i].x, strokeSamples[i].y);
+			if (event.type == InputEventType::Release)
+				currentStroke->finish();
+			damage.add(currentStroke->getBoundsSince(firstNew));
+			if (event.type == InputEventType::Release)
+				currentStroke = NULL;
+		}
+	}
+	applyDrag();
+	//Reshaped once per frame however many samples arrived
+	if (lassoChanged) {
+		Shape* lasso = scene.getShape(lassoShape);
+		damage.add(lasso->getBounds());
+		lasso->reshape(lassoOutline.data(), lassoOutline.size());
+		damage.add(lasso->getBounds());
 	}
 }
+
 void screenResizeEvent(GLFWwindow* window, int width, int height)
 {
 	WINDOW_WIDTH = width;
 	WINDOW_HEIGHT = height;
 	glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (!updateWorker.isRunning()) //the update thread owns the damage while it runs
+		damage.addAll();
+}
+
+void screenRefreshEvent(GLFWwindow* window)
+{
+	if (!updateWorker.isRunning())
+		damage.addAll();
 }
 void initializeGLFW() {
+	TRACE_SCOPE("startup", "initializeGLFW");
 	glewExperimental = true; // Needed for core profile
 	if (!glfwInit())
 	{
-		printf("Failed to initialize GLFW\n");
+		LOG_ERROR(LogCategory::General, "Failed to initialize GLFW");
 		return;
 	}
 
 	glfwWindowHint(GLFW_SAMPLES, 4); // 4x antialiasing
+	glfwWindowHint(GLFW_STENCIL_BITS, 8); // For outlines filled through the stencil
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); // We want OpenGL 3.3
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
@@ -80,123 +208,400 @@ void initializeGLFW() {
 }
 
 void initializeWindow() {
+	TRACE_SCOPE("startup", "initializeWindow");
 	// Open a window and create its OpenGL context
 	window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Computer Graphics", NULL, NULL);
 	if (window == NULL) {
-		printf("Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n");
+		LOG_ERROR(LogCategory::General, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.");
 		glfwTerminate();
 		return;
 	}
 	glfwSetCursorPosCallback(window, mouseMoveEvent);
 	glfwSetMouseButtonCallback(window, mouseClickEvent);
 	glfwSetFramebufferSizeCallback(window, screenResizeEvent);
+	glfwSetWindowRefreshCallback(window, screenRefreshEvent);
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 }
 
 void initializeGLEW() {
+	TRACE_SCOPE("startup", "initializeGLEW");
 	glfwMakeContextCurrent(window); // Initialize GLEW
 	glewExperimental = true; // Needed in core profile
 	if (glewInit() != GLEW_OK) {
-		printf("Failed to initialize GLEW\n");
+		LOG_ERROR(LogCategory::General, "Failed to initialize GLEW");
 		return;
 	}
 }
 
 
-void initializeShapes() {
-	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
+void initializeDrawState() {
+	TRACE_SCOPE("startup", "initializeDrawState");
+	vertexArray = GLVertexArray::create();
+	glBindVertexArray(vertexArray.get());
+	strokeShader = LoadShadersCached("shaders/circle/vertex.shader", "shaders/circle/fragment.shader");
+}
 
-	shapes = new Shape * [SHAPE_COUNT];
-	Vertex vertex[][3] =
-	{
-		{ Vertex(-0.45f, 0), Vertex(-0.085f, 0.25f), Vertex(0.25f, 0) },
-		{ Vertex(-0.45, 0), Vertex(0.25f, -0.45f), Vertex(0.25f, 0) },
-		{ Vertex(-0.45, 0), Vertex(-0.45f, -0.45f), Vertex(0.25f, -0.45f) },
-		{ Vertex(0, -0.45f), Vertex(0.15f, -0.25f), Vertex(0.15f, -0.45f) },
-		{ Vertex(0, -0.45f), Vertex(0, -0.25f), Vertex(0.15f, -0.25f) },
-		{ Vertex(-0.65f , -0.45f), Vertex(-0.75f , -0.1f), Vertex(-0.85f, -0.45f) },
-		{ Vertex(-0.35f , -0.15f), Vertex(-0.25f , -0.05f), Vertex(-0.15f, -0.15f) },
-		{ Vertex(-0.35f , -0.15f), Vertex(-0.25f , -0.25f), Vertex(-0.15f, -0.15f) },
-		{ Vertex(-0.95f , -0.25f), Vertex(-0.75f , -0.1f), Vertex(-0.55f, -0.25f) },
-		{ Vertex(-0.95f , -0.15f), Vertex(-0.75f , 0), Vertex(-0.55f, -0.15f) },
-		{ Vertex(-0.87f , -0.05f), Vertex(-0.75f , 0.15f), Vertex(-0.65f, -0.05f) },
-		{ Vertex(-1 , -0.45f), Vertex(-1 , -0.75f), Vertex(1 , -0.45f) },
-		{ Vertex(1 , -0.45f), Vertex(1 , -0.75f), Vertex(-1 , -0.75f) },
-		{ Vertex(0.27f , -0.35f), Vertex(0.27f, -0.2f), Vertex(0.67f , -0.35f) },
-		{ Vertex(0.67f , -0.35f), Vertex(0.27f , -0.2f), Vertex(0.67f , -0.2f) },
-		{ Vertex(0.35f , -0.2f), Vertex(0.51f , -0.2f), Vertex(0.37f , -0.05f) },
-		{ Vertex(0.37f , -0.05f), Vertex(0.51f , -0.2f), Vertex(0.55f , -0.05f) },
-		{ Vertex(0.55f , -0.05f), Vertex(0.51f , -0.2f), Vertex(0.6f, -0.2f) },
-		{ Vertex(0.75f , -0.02f), Vertex(0.75f , -0.45f), Vertex(0.78f , -0.02f) },
-		{ Vertex(0.75f , -0.45f), Vertex(0.78f , -0.02f), Vertex(0.78f , -0.45f) },
-		{ Vertex(0.75f , -0.12f), Vertex(0.765f , -0.02f), Vertex(0.78f , -0.12f) }
-	};
-
-	int triangle_count = 15;
-
-	for (int i = 0; i < triangle_count; i++) {
-		shapes[i] = new Triangle(vertex[i], 0.5f, 0.5f);
-	}
-
-	shapes[15] = new Circle(0.65, -0.275, 0, 100, 0.077, 1);
-	shapes[16] = new Circle(0.35, -0.376, 0, 100, 0.077, 1);
-	shapes[17] = new Circle(0.6, -0.376, 0, 100, 0.077, 1);
-	shapes[18] = new Circle(0.6, -0.376, 0, 100, 0.04, 1);
-	shapes[19] = new Circle(0.35, -0.376, 0, 100, 0.04, 1);
-
-	shapes[20] = new Triangle(vertex[15], 0.5f, 0.5f);
-	shapes[21] = new Triangle(vertex[16], 0.5f, 0.5f);
-	shapes[22] = new Triangle(vertex[17], 0.5f, 0.5f);
-	shapes[23] = new Triangle(vertex[18], 0.5f, 0.5f);
-	shapes[24] = new Triangle(vertex[19], 0.5f, 0.5f);
-
-	shapes[25] = new Circle(0.765, -0.02, 0, 100, 0.1, 1);
-	shapes[26] = new Triangle(vertex[20], 0.5f, 0.5f);
-
-	shapes[27] = new Circle(0, 0.7, 0, 100, 0.17, 1);
-	shapes[28] = new Circle(-0.1, 0.7, 0, 100, 0.17, 1);
+//The shape shift-drag draws: its outline is filled through the stencil buffer, so
+//it may cross itself. It starts empty and each new drag replaces it.
+void initializeLasso() {
+	lassoShape = scene.getShapeCount();
+	Shape& lasso = scene.create<StencilPolygon>((const Vertex*)NULL, 0);
+	lasso.initiateBuffer();
+	lasso.initiateShader("shaders/triangle/vertex_1.shader", "shaders/triangle/blue.shader");
+}
+
+void initializeShapes() {
+	TRACE_SCOPE("startup", "initializeShapes");
+	//Geometry was generated at compile time; shapes draw straight from the table
+	for (int i = 0; i < STATIC_SCENE.rangeCount; i++) {
+		const BakedRange& range = STATIC_SCENE.ranges[i];
+		scene.create<Shape>(STATIC_SCENE.vertices + range.first, range.count, range.position);
+	}
 
 	char vertexShader[][100] = { "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader","shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader","shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader","shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader","shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader", "shaders/triangle/vertex_1.shader" };
 	char fragmentShader[][100] = { "shaders/circle/fragment.shader", "shaders/triangle/red.shader", "shaders/triangle/red.shader","shaders/triangle/blue.shader","shaders/triangle/blue.shader", "shaders/triangle/brown.shader", "shaders/triangle/yellow.shader", "shaders/triangle/yellow.shader", "shaders/triangle/green.shader", "shaders/triangle/green.shader", "shaders/triangle/green.shader", "shaders/triangle/grey.shader", "shaders/triangle/grey.shader", "shaders/circle/fragment.shader", "shaders/circle/fragment.shader", "shaders/circle/fragment.shader","shaders/triangle/grey.shader", "shaders/triangle/grey.shader", "shaders/triangle/white.shader", "shaders/triangle/white.shader", "shaders/triangle/white.shader", "shaders/triangle/white.shader", "shaders/triangle/white.shader", "shaders/triangle/brown2.shader", "shaders/triangle/brown2.shader", "shaders/triangle/white.shader", "shaders/triangle/red.shader", "shaders/triangle/yellow.shader", "shaders/triangle/black.shader" };
-	char fragmentOutlineShader[][100] = { "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader" };
+	char fragmentOutlineShader[][100] = { "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader","shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader", "shaders/triangle/fragment_outline_2.shader" };
 
 	for (int i = 0; i < SHAPE_COUNT; i++)
 	{
-		shapes[i]->initiateBuffer();
-		shapes[i]->initiateShader(vertexShader[i], fragmentShader[i]);
-		shapes[i]->initiateOutlineShader(vertexShader[i], fragmentOutlineShader[i]);
+		scene.getShape(i)->initiateBuffer();
+		scene.getShape(i)->initiateShader(vertexShader[i], fragmentShader[i]);
+		scene.getShape(i)->initiateOutlineShader(vertexShader[i], fragmentOutlineShader[i]);
 	}
 }
 
-void render() {
-	glEnableVertexAttribArray(0);
+//Runs on the update thread with --threaded: everything drawFrame does to the
+//scene, with the GL calls written into list for the render thread
+void recordFrame(CommandList& list) {
+	processInput();
+	list.clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	scene.record(list);
+}
 
+void drawFrame() {
+	TRACE_SCOPE("render", "frame");
+	if (updateWorker.isRunning()) {
+		ShaderCompiler::instance().poll();
+		CommandList& list = updateWorker.acquire();
+		{
+			TRACE_SCOPE("render", "replay");
+			list.replay(commandBuffers);
+		}
+		updateWorker.release();
+	}
+	else {
+		processInput();
+		ShaderCompiler::instance().poll();
+		bool streaming = sceneFile.isOpen() && !sceneStreamer.isDone();
+		if (streaming)
+			sceneStreamer.update(scene);
+		glStencilMask(0xFF);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		scene.draw();
+		damage.clear(); //everything was just drawn
+		//Streaming adds shapes and their buffers on this thread, so the worker waits until it is done
+		if (threaded && !streaming)
+			updateWorker.start(recordFrame);
+	}
+
+	// Swap buffers
+	{
+		TRACE_SCOPE("render", "swap");
+		glfwSwapBuffers(window);
+	}
+	glfwPollEvents();
+}
+
+bool isRunning() {
+	// Check if the ESC key was pressed or the window was closed
+	return glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(window) == 0;
+}
+
+const char* describeFrameTimes(FrameStats& stats, char* text, size_t size) {
+	char pacing[32];
+	snprintf(text, size, "%s: %d frames in %.3f s, %.1f fps, mean %.3f ms, stddev %.3f ms, min %.3f ms, p99 %.3f ms, max %.3f ms",
+		framePacer.describe(pacing, sizeof(pacing)), stats.getCount(), stats.getTotal(), stats.getTotal() > 0 ? stats.getCount() / stats.getTotal() : 0,
+		stats.getMean() * 1000.0, stats.getStdDev() * 1000.0, stats.getMin() * 1000.0, stats.getPercentile(0.99) * 1000.0, stats.getMax() * 1000.0);
+	return text;
+}
+
+//Draws until the window closes, or for exactly benchmarkFrames frames when that is
+//above 0. Frame times are measured start to start, so they include the pacer's wait.
+void render(int benchmarkFrames = 0) {
+	const double REPORT_INTERVAL = 5.0;
+	glfwSwapInterval(framePacer.getSwapInterval());
+	glEnableVertexAttribArray(0);
+	FrameStats stats;
+	double last = glfwGetTime(), reported = last;
 	do {
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		for (int i = 0; i < SHAPE_COUNT; i++) {
-			shapes[i]->drawPolygon();
-			shapes[i]->drawPolyline();
+		drawFrame();
+		framePacer.wait();
+		double now = glfwGetTime();
+		stats.add(now - last);
+		last = now;
+		if (benchmarkFrames > 0 && stats.getCount() >= benchmarkFrames)
+			break;
+		if (benchmarkFrames == 0 && now - reported >= REPORT_INTERVAL) {
+			char text[256];
+			LOG_INFO(LogCategory::Render, "Frame times %s", describeFrameTimes(stats, text, sizeof(text)));
+			stats.clear();
+			reported = now;
 		}
-		for (int i = 0; i < dot.size(); i++) {
-			dot[i]->drawPolygon();
+	} while (isRunning());
+	if (benchmarkFrames > 0) {
+		char text[256];
+		printf("%s\n", describeFrameTimes(stats, text, sizeof(text)));
+	}
+	glDisableVertexAttribArray(0);
+}
+
+//Brings in whatever changed since the last frame and records where it landed.
+//Returns true while shaders or the scene are still loading in the background.
+bool updateOnDemand() {
+	processInput();
+	static bool wasCompiling = false;
+	bool compiling = ShaderCompiler::instance().poll();
+	//Finished programs replace placeholders anywhere on screen
+	if (compiling || wasCompiling)
+		damage.addAll();
+	wasCompiling = compiling;
+	if (sceneFile.isOpen() && !sceneStreamer.isDone()) {
+		int first = scene.getShapeCount();
+		sceneStreamer.update(scene);
+		for (int i = first; i < scene.getShapeCount(); i++)
+			damage.add(scene.getShape(i)->getBounds());
+	}
+	return compiling || (sceneFile.isOpen() && !sceneStreamer.isDone());
+}
+
+//Redraws only the damaged rectangles into the retained frame, each clipped by
+//scissor and culled to the shapes that reach into it, then shows the result.
+void drawDamage() {
+	TRACE_SCOPE("render", "damaged frame");
+	if (!retainedFrame.hasSize(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+		retainedFrame.resize(WINDOW_WIDTH, WINDOW_HEIGHT);
+		damage.addAll();
+	}
+	if (!retainedFrame.isValid())
+		damage.addAll();
+	else
+		retainedFrame.bind();
+
+	Bounds view = scene.getView();
+	//Stencil fills expect a clear stencil wherever they draw
+	glStencilMask(0xFF);
+	if (damage.isEverything()) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		scene.draw();
+	}
+	else {
+		glEnable(GL_SCISSOR_TEST);
+		for (int i = 0; i < damage.getRects().size(); i++) {
+			Bounds rect = damage.getRects()[i];
+			GLint x, y;
+			GLsizei width, height;
+			damageToPixels(rect, WINDOW_WIDTH, WINDOW_HEIGHT, 2, x, y, width, height);
+			if (width == 0 || height == 0)
+				continue;
+			glScissor(x, y, width, height);
+			glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+			scene.setView(rect);
+			scene.draw();
 		}
+		glDisable(GL_SCISSOR_TEST);
+		scene.setView(view);
+	}
+	damage.clear();
 
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	if (retainedFrame.isValid())
+		retainedFrame.present();
+	TRACE_SCOPE("render", "swap");
+	glfwSwapBuffers(window);
+}
+
+//Sleeps in glfwWaitEvents until something changes. The logger, shader reader and
+//job workers block while idle too, so an idle window costs no CPU. Loading and
+//shader builds keep it waking up until they are done.
+void renderOnDemand() {
+	glfwSwapInterval(framePacer.getSwapInterval());
+	glEnableVertexAttribArray(0);
+	damage.addAll();
+	bool busy = true;
+	do {
+		if (!damage.isEmpty())
+			glfwPollEvents();
+		else if (busy)
+			glfwWaitEventsTimeout(0.01);
+		else
+			glfwWaitEvents();
+		busy = updateOnDemand();
+		if (!damage.isEmpty()) {
+			drawDamage();
+			framePacer.wait();
+		}
+	} while (isRunning());
+	glDisableVertexAttribArray(0);
+}
+
+//Replaces the scene with generated content of each requested size and reports startup, memory and frame time
+void runStressTest(const vector<int>& sizes, ShapeMix mix, unsigned seed, int frames) {
+	glfwSwapInterval(framePacer.getSwapInterval());
+	glEnableVertexAttribArray(0);
+	printf("%10s %10s %12s %12s %12s %12s %12s %12s\n", "shapes", "vertices", "startup ms", "memory MB", "frame ms", "stddev ms", "min ms", "max ms");
+	for (int s = 0; s < sizes.size() && isRunning(); s++) {
+		scene.clear();
+		currentStroke = NULL;
+		selected = SceneItem();
+		glFinish();
+		size_t memoryBefore = getResidentMemory();
+		double start = glfwGetTime();
+
+		SceneGenerator generator(mix, seed);
+		generator.generate(scene, sizes[s]);
+		generator.initiate(scene);
+		ShaderCompiler::instance().finish();
+		glFinish();
 
-	} // Check if the ESC key was pressed or the window was closed
-	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-		glfwWindowShouldClose(window) == 0);
+		double startup = glfwGetTime() - start;
+		size_t memoryAfter = getResidentMemory();
+		double memory = memoryAfter > memoryBefore ? (memoryAfter - memoryBefore) / (1024.0 * 1024.0) : 0;
+
+		FrameStats stats;
+		double last = glfwGetTime();
+		for (int drawn = 0; drawn < frames && isRunning(); drawn++) {
+			drawFrame();
+			glFinish();
+			framePacer.wait();
+			double now = glfwGetTime();
+			stats.add(now - last);
+			last = now;
+		}
+		printf("%10d %10lld %12.2f %12.2f %12.3f %12.3f %12.3f %12.3f\n", sizes[s], scene.getVertexCount(), startup * 1000.0, memory,
+			stats.getMean() * 1000.0, stats.getStdDev() * 1000.0, stats.getMin() * 1000.0, stats.getMax() * 1000.0);
+	}
 	glDisableVertexAttribArray(0);
 }
 
-int main()
+vector<int> parseSizes(const char* text) {
+	vector<int> sizes;
+	stringstream stream(text);
+	string item;
+	while (getline(stream, item, ','))
+		if (atoi(item.c_str()) > 0)
+			sizes.push_back(atoi(item.c_str()));
+	return sizes;
+}
+
+int main(int argc, char* argv[])
 {
+	// --stress [1000,10000,100000] [--mix triangle,circle,box,ovaloid,vase] [--seed n] [--frames n]
+	// --log trace|debug|info|warn|error|off
+	// --load scene.bin (instead of the built-in scene) --save scene.bin (on exit)
+	// --shader-cache directory|off --shaders-from-disk (read shaders/ instead of the built-in copies)
+	// --trace trace.json (Chrome trace of startup and every frame, open in Perfetto)
+	// --on-demand (only redraw what changed, sleep while idle)
+	// --pacing vsync|uncapped|hz --benchmark (draw --frames frames, print throughput and exit)
+	// --threaded (update and record draws on a second thread, replay them on this one)
+	// --vertex-format norm16|half|float2|float3 (smallest layout shape buffers may use)
+	bool stress = false;
+	bool onDemand = false;
+	bool benchmark = false;
+	const char* pacing = NULL;
+	vector<int> stressSizes = parseSizes("1000,10000,100000");
+	ShapeMix mix;
+	unsigned seed = SceneGenerator::DEFAULT_SEED;
+	int frames = 100;
+	const char* loadPath = NULL;
+	const char* savePath = NULL;
+	const char* tracePath = NULL;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+		if (arg == "--stress") {
+			stress = true;
+			if (hasValue)
+				stressSizes = parseSizes(argv[++i]);
+		}
+		else if (arg == "--mix" && hasValue)
+			sscanf(argv[++i], "%d,%d,%d,%d,%d", &mix.triangle, &mix.circle, &mix.box, &mix.ovaloid, &mix.vase);
+		else if (arg == "--seed" && hasValue)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (arg == "--frames" && hasValue)
+			frames = atoi(argv[++i]);
+		else if (arg == "--load" && hasValue)
+			loadPath = argv[++i];
+		else if (arg == "--save" && hasValue)
+			savePath = argv[++i];
+		else if (arg == "--trace" && hasValue)
+			tracePath = argv[++i];
+		else if (arg == "--on-demand")
+			onDemand = true;
+		else if (arg == "--pacing" && hasValue)
+			pacing = argv[++i];
+		else if (arg == "--benchmark")
+			benchmark = true;
+		else if (arg == "--threaded")
+			threaded = true;
+		else if (arg == "--jobs" && hasValue)
+			JobSystem::instance().setWorkerCount(atoi(argv[++i]) - 1);
+		else if (arg == "--vertex-format" && hasValue) {
+			if (!parseVertexFormat(argv[++i], preferredVertexFormat()))
+				LOG_WARN(LogCategory::General, "Unknown vertex format %s, expected norm16, half, float2 or float3", argv[i]);
+		}
+		else if (arg == "--shaders-from-disk")
+			shaderSourcesFromDisk() = true;
+		else if (arg == "--shader-cache" && hasValue) {
+			string directory = argv[++i];
+			ShaderCompiler::instance().setCacheDirectory(directory == "off" ? "" : directory.c_str());
+		}
+		else if (arg == "--log" && hasValue) {
+			LogLevel level;
+			if (Logger::parseLevel(argv[++i], level))
+				Logger::setLevel(level);
+		}
+	}
+
+	//Measurements run flat out unless asked otherwise; the window follows the display
+	framePacer.setMode(stress || benchmark ? PacingMode::Uncapped : PacingMode::Vsync);
+	if (pacing != NULL && !framePacer.parse(pacing))
+		LOG_WARN(LogCategory::General, "Unknown pacing %s, expected vsync, uncapped or a rate in Hz", pacing);
+	//Both rebuild or redraw the scene from this thread
+	if (threaded && (stress || onDemand)) {
+		LOG_WARN(LogCategory::General, "--threaded is ignored with --stress and --on-demand");
+		threaded = false;
+	}
+
+	if (tracePath != NULL) {
+		Tracer::instance().setThreadName("main");
+		Tracer::instance().start();
+	}
 	initializeGLFW();
 	initializeWindow();
 	initializeGLEW();
-	initializeShapes();
-	render();
+	initializeDrawState();
+	if (stress)
+		runStressTest(stressSizes, mix, seed, frames);
+	else {
+		if (loadPath == NULL || !sceneFile.open(loadPath))
+			initializeShapes();
+		else
+			sceneStreamer.start();
+		initializeLasso();
+		if (benchmark) {
+			ShaderCompiler::instance().finish();
+			render(frames > 0 ? frames : 1);
+		}
+		else if (onDemand)
+			renderOnDemand();
+		else
+			render();
+	}
+	updateWorker.stop();
+	sceneStreamer.stop();
+	if (savePath != NULL)
+		SceneFile::write(savePath, scene);
+	ShaderCompiler::instance().shutdown();
+	if (tracePath != NULL && !Tracer::instance().write(tracePath))
+		LOG_ERROR(LogCategory::General, "Cannot write trace to %s", tracePath);
+	Logger::instance().shutdown();
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <atomic>
+
+//Fixed-size single-producer/single-consumer ring buffer. One thread may push
+//while another pops without locks; Capacity must be a power of two.
+template<typename T, size_t Capacity>
+class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+	T items[Capacity];
+	alignas(64) std::atomic<size_t> head; //next slot to pop
+	alignas(64) std::atomic<size_t> tail; //next slot to push
+public:
+	SpscQueue() : head(0), tail(0) {}
+	bool push(const T& item) {
+		size_t position = tail.load(std::memory_order_relaxed);
+		if (position - head.load(std::memory_order_acquire) == Capacity)
+			return false;
+		items[position & (Capacity - 1)] = item;
+		tail.store(position + 1, std::memory_order_release);
+		return true;
+	}
+	bool pop(T& item) {
+		size_t position = head.load(std::memory_order_relaxed);
+		if (position == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[position & (Capacity - 1)];
+		head.store(position + 1, std::memory_order_release);
+		return true;
+	}
+	size_t size() {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <glew.h>
+
+//How a shape's points become a filled area. Triangles draws them as listed;
+//the other two treat them as one closed outline filled through the stencil
+//buffer, deciding what is inside by crossing parity or by winding number.
+enum class FillRule : uint8_t { Triangles, EvenOdd, NonZero };
+
+//Fills the outline in the bound buffer's first outlineCount points without
+//triangulating it. A fan from the first point is drawn into the stencil buffer
+//alone, so every pixel ends up counting how often the fan covers it: flipping a
+//bit for even-odd, or up for counter-clockwise triangles and down for clockwise
+//ones for non-zero. The COVER_POINTS points after the outline, a quad around it,
+//are then drawn where the count says inside, zeroing the stencil as they go so
+//the next outline starts from a clear buffer. Outlines may cross themselves.
+const int COVER_POINTS = 4;
+inline void drawStencilFill(FillRule rule, GLsizei outlineCount) {
+	glEnable(GL_STENCIL_TEST);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glStencilFunc(GL_ALWAYS, 0, 0xFF);
+	if (rule == FillRule::EvenOdd) {
+		glStencilMask(0x01);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+	}
+	else {
+		glStencilMask(0xFF);
+		glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
+		glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
+	}
+	glDrawArrays(GL_TRIANGLE_FAN, 0, outlineCount);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glStencilMask(0xFF);
+	glStencilFunc(GL_NOTEQUAL, 0, rule == FillRule::EvenOdd ? 0x01 : 0xFF);
+	glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+	glDrawArrays(GL_TRIANGLE_FAN, outlineCount, COVER_POINTS);
+	glDisable(GL_STENCIL_TEST);
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <math.h>
+#include "Shape.h"
+#include "Arena.h"
+#include "GLHandle.h"
+#include "CommandList.h"
+
+//A drag path drawn as one thick ribbon with round joins and caps. Triangles are
+//appended as points arrive and uploaded into a single growing buffer, so a whole
+//stroke is one draw call and its size depends on path length, not sample count.
+class Stroke {
+	Vertex* vertices;
+	int count, capacity;
+	Arena* arena; //where vertex storage comes from, NULL for the heap
+	GLBuffer buffer;
+	int uploaded, bufferCapacity;
+	int slotUploaded, slotCapacity; //the same for a command list's slot buffer, which starts out empty
+	GLuint shader;
+	float halfWidth;
+	float maxJoinStep; //largest angle covered by one triangle of a round join or cap
+	Vertex last, lastNormal;
+	Bounds bounds;
+	BoundsList* boundsList; //the scene's copy of the bounds, NULL outside a scene
+	int boundsSlot;
+	int pointCount;
+	bool finished;
+
+	void reserve(int needed) {
+		if (needed <= capacity)
+			return;
+		int grown = capacity == 0 ? 96 : capacity * 2;
+		while (grown < needed)
+			grown *= 2;
+		Vertex* next = arena != NULL ? arena->allocateArray<Vertex>(grown) : new Vertex[grown];
+		for (int i = 0; i < count; i++)
+			next[i] = vertices[i];
+		//Arena blocks are only reclaimed when the scene is reset
+		if (arena == NULL)
+			delete[] vertices;
+		vertices = next;
+		capacity = grown;
+	}
+	void addTriangle(const Vertex& a, const Vertex& b, const Vertex& c) {
+		reserve(count + 3);
+		vertices[count++] = a;
+		vertices[count++] = b;
+		vertices[count++] = c;
+		bounds.expand(a);
+		bounds.expand(b);
+		bounds.expand(c);
+		if (boundsList != NULL)
+			boundsList->set(boundsSlot, bounds);
+	}
+	//Fan around center starting at startAngle and turning by sweep radians
+	void addFan(const Vertex& center, float startAngle, float sweep) {
+		int steps = (int)ceilf(fabsf(sweep) / maxJoinStep);
+		if (steps < 1)
+			steps = 1;
+		float step = sweep / steps;
+		Vertex previous(center.x + cosf(startAngle) * halfWidth, center.y + sinf(startAngle) * halfWidth);
+		for (int i = 1; i <= steps; i++) {
+			float angle = startAngle + step * i;
+			Vertex next(center.x + cosf(angle) * halfWidth, center.y + sinf(angle) * halfWidth);
+			addTriangle(center, previous, next);
+			previous = next;
+		}
+	}
+public:
+	Stroke(float width = 0.01f, int roundSegments = 8) {
+		vertices = NULL;
+		count = capacity = 0;
+		arena = Arena::active();
+		halfWidth = width / 2;
+		maxJoinStep = 3.14159265f / roundSegments;
+		uploaded = 0;
+		bufferCapacity = 0;
+		slotUploaded = slotCapacity = 0;
+		shader = 0;
+		boundsList = NULL;
+		boundsSlot = -1;
+		pointCount = 0;
+		finished = false;
+	}
+	Stroke(const Stroke&) = delete;
+	Stroke& operator=(const Stroke&) = delete;
+	Stroke(Stroke&& other) noexcept : buffer(std::move(other.buffer)) {
+		vertices = other.vertices;
+		count = other.count;
+		capacity = other.capacity;
+		arena = other.arena;
+		uploaded = other.uploaded;
+		bufferCapacity = other.bufferCapacity;
+		slotUploaded = other.slotUploaded;
+		slotCapacity = other.slotCapacity;
+		shader = other.shader;
+		halfWidth = other.halfWidth;
+		maxJoinStep = other.maxJoinStep;
+		last = other.last;
+		lastNormal = other.lastNormal;
+		bounds = other.bounds;
+		boundsList = other.boundsList;
+		boundsSlot = other.boundsSlot;
+		pointCount = other.pointCount;
+		finished = other.finished;
+		other.vertices = NULL;
+		other.count = other.capacity = 0;
+		other.boundsList = NULL;
+	}
+	~Stroke() {
+		if (arena == NULL)
+			delete[] vertices;
+	}
+	int getPointSize() {
+		return count;
+	}
+	Vertex* getPoints() {
+		return vertices;
+	}
+	Bounds getBounds() {
+		return bounds;
+	}
+	void trackBounds(BoundsList* list) {
+		boundsList = list;
+		boundsSlot = list->add(bounds);
+	}
+	//Bounds of the triangles from vertex first on, e.g. the ones added this frame
+	Bounds getBoundsSince(int first) {
+		Bounds added;
+		for (int i = first; i < count; i++)
+			added.expand(vertices[i]);
+		return added;
+	}
+	bool contains(float x, float y) {
+		return bounds.contains(x, y) && trianglesContain(vertices, NULL, count, x, y);
+	}
+	//Moves every triangle; the whole stroke is uploaded again on the next draw
+	void translate(const Vertex& movement) {
+		for (int i = 0; i < count; i++)
+			vertices[i] = vertices[i] + movement;
+		last = last + movement;
+		bounds.translate(movement);
+		if (boundsList != NULL)
+			boundsList->set(boundsSlot, bounds);
+		uploaded = slotUploaded = 0;
+	}
+	bool isFinished() {
+		return finished;
+	}
+	void initiateShader(const char vertex[], const char fragment[]) {
+		shader = LoadShadersCached(vertex, fragment);
+	}
+	void setShader(GLuint program) {
+		shader = program;
+	}
+	GLuint getShader() {
+		return shader;
+	}
+	void addPoint(float x, float y) {
+		Vertex point(x, y);
+		if (pointCount == 0) {
+			last = point;
+			pointCount = 1;
+			return;
+		}
+		Vertex delta = point - last;
+		float length = sqrtf(delta.x * delta.x + delta.y * delta.y);
+		if (length < 1e-6f)
+			return;
+		Vertex normal(-delta.y / length * halfWidth, delta.x / length * halfWidth);
+		float normalAngle = atan2f(normal.y, normal.x);
+
+		if (pointCount == 1) {
+			//Start cap: half circle from the left edge around the back to the right edge
+			addFan(last, normalAngle, 3.14159265f);
+		}
+		else {
+			//Round join on the outer side of the turn
+			float turn = lastNormal.x * normal.y - lastNormal.y * normal.x;
+			float previousAngle = atan2f(lastNormal.y, lastNormal.x);
+			float sweep = normalAngle - previousAngle;
+			if (sweep > 3.14159265f)
+				sweep -= 2 * 3.14159265f;
+			else if (sweep < -3.14159265f)
+				sweep += 2 * 3.14159265f;
+			if (turn > 0)
+				addFan(last, previousAngle + 3.14159265f, sweep);
+			else if (turn < 0)
+				addFan(last, previousAngle, sweep);
+		}
+
+		Vertex leftStart = last + normal, rightStart = last - normal;
+		Vertex leftEnd = point + normal, rightEnd = point - normal;
+		addTriangle(leftStart, rightStart, leftEnd);
+		addTriangle(rightStart, rightEnd, leftEnd);
+
+		last = point;
+		lastNormal = normal;
+		pointCount++;
+	}
+	//Closes the stroke with an end cap, or a full dot if it never moved
+	void finish() {
+		if (finished || pointCount == 0)
+			return;
+		if (pointCount == 1)
+			addFan(last, 0, 2 * 3.14159265f);
+		else
+			addFan(last, atan2f(-lastNormal.y, -lastNormal.x), 3.14159265f);
+		finished = true;
+	}
+	//Sends only the triangles added since the last upload; the buffer doubles when full
+	void upload() {
+		if (count == uploaded)
+			return;
+		if (buffer.get() == 0)
+			buffer = GLBuffer::create();
+		glBindBuffer(GL_ARRAY_BUFFER, buffer.get());
+		if (count > bufferCapacity) {
+			bufferCapacity = bufferCapacity == 0 ? 1024 : bufferCapacity;
+			while (bufferCapacity < count)
+				bufferCapacity *= 2;
+			glBufferData(GL_ARRAY_BUFFER, bufferCapacity * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+			uploaded = 0;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, uploaded * sizeof(Vertex), (count - uploaded) * sizeof(Vertex), &vertices[uploaded]);
+		uploaded = count;
+	}
+	//Like drawPolygon, but written into list for another thread to replay. The
+	//list's slot buffer stands in for the stroke's own and keeps counters of its
+	//own, since a stroke drawn directly before recording began has filled only
+	//its own buffer and the slot still has to be given everything.
+	void recordPolygon(CommandList& list, int slot) {
+		if (count > slotCapacity) {
+			slotCapacity = slotCapacity == 0 ? 1024 : slotCapacity;
+			while (slotCapacity < count)
+				slotCapacity *= 2;
+			list.allocate(slot, slotCapacity * sizeof(Vertex));
+			slotUploaded = 0;
+		}
+		if (count > slotUploaded) {
+			list.upload(0, slot, slotUploaded * sizeof(Vertex), &vertices[slotUploaded], (count - slotUploaded) * sizeof(Vertex), false);
+			slotUploaded = count;
+		}
+		if (slotUploaded > 0)
+			list.draw(shader, 0, slot, 0, GL_TRIANGLES, slotUploaded);
+	}
+	void drawPolygon() {
+		upload();
+		if (uploaded == 0)
+			return;
+		glUseProgram(resolveProgram(shader));
+		glBindBuffer(GL_ARRAY_BUFFER, buffer.get());
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		glDrawArrays(GL_TRIANGLES, 0, uploaded);
+	}
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Spans are removed from the build entirely when this is 0
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+struct TraceEvent {
+	const char* name; //string literals, so only the pointer is kept
+	const char* category;
+	int64_t start, duration; //nanoseconds since the tracer started
+	std::string detail; //optional, e.g. the file a span worked on
+};
+
+//Records nested timing spans on every thread and writes them out as Chrome
+//trace_event JSON, which chrome://tracing and Perfetto open directly. Each
+//thread appends to its own buffer, so spans on different threads never
+//contend; when tracing is off a span costs one relaxed load.
+class Tracer {
+	struct ThreadBuffer {
+		std::mutex lock; //only contended while write() copies the buffer out
+		std::vector<TraceEvent> events;
+		std::string name;
+		int id;
+		size_t dropped;
+	};
+	static const size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+	std::atomic<bool> enabled;
+	std::chrono::steady_clock::time_point origin;
+	std::mutex registryLock;
+	std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+	Tracer() {
+		enabled.store(false);
+		origin = std::chrono::steady_clock::now();
+	}
+	ThreadBuffer& buffer() {
+		static thread_local ThreadBuffer* current = NULL;
+		if (current == NULL) {
+			std::lock_guard<std::mutex> guard(registryLock);
+			threads.emplace_back(new ThreadBuffer());
+			current = threads.back().get();
+			current->id = threads.size();
+			current->dropped = 0;
+			char name[32];
+			snprintf(name, sizeof(name), "thread %d", current->id);
+			current->name = name;
+		}
+		return *current;
+	}
+	static void writeEscaped(FILE* out, const std::string& text) {
+		for (size_t i = 0; i < text.size(); i++) {
+			unsigned char c = text[i];
+			if (c == '"' || c == '\\')
+				fprintf(out, "\\%c", c);
+			else if (c < 0x20)
+				fprintf(out, "\\u%04x", c);
+			else
+				fputc(c, out);
+		}
+	}
+public:
+	static Tracer& instance() {
+		static Tracer tracer;
+		return tracer;
+	}
+	static bool isEnabled() {
+		return instance().enabled.load(std::memory_order_relaxed);
+	}
+	void start() {
+		enabled.store(true);
+	}
+	void stop() {
+		enabled.store(false);
+	}
+	int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+	}
+	//Names the calling thread's track in the trace viewer
+	void setThreadName(const char* name) {
+		ThreadBuffer& current = buffer();
+		std::lock_guard<std::mutex> guard(current.lock);
+		current.name = name;
+	}
+	void record(const char* category, const char* name, int64_t start, int64_t end, const char* detail = NULL) {
+		ThreadBuffer& current = buffer();
+		std::lock_guard<std::mutex> guard(current.lock);
+		if (current.events.size() >= MAX_EVENTS_PER_THREAD) {
+			current.dropped++;
+			return;
+		}
+		current.events.push_back(TraceEvent());
+		TraceEvent& event = current.events.back();
+		event.name = name;
+		event.category = category;
+		event.start = start;
+		event.duration = end - start;
+		if (detail != NULL)
+			event.detail = detail;
+	}
+	//Writes everything recorded so far. Threads may keep tracing meanwhile.
+	bool write(const char* path) {
+		FILE* out = fopen(path, "w");
+		if (out == NULL)
+			return false;
+		fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		bool first = true;
+		std::lock_guard<std::mutex> registry(registryLock);
+		for (size_t t = 0; t < threads.size(); t++) {
+			ThreadBuffer& thread = *threads[t];
+			std::lock_guard<std::mutex> guard(thread.lock);
+			fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",\n", thread.id);
+			writeEscaped(out, thread.name);
+			fprintf(out, "\"}}");
+			first = false;
+			for (size_t i = 0; i < thread.events.size(); i++) {
+				const TraceEvent& event = thread.events[i];
+				fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", event.name, event.category,
+					thread.id, event.start / 1000.0, event.duration / 1000.0);
+				if (!event.detail.empty()) {
+					fprintf(out, ",\"args\":{\"detail\":\"");
+					writeEscaped(out, event.detail);
+					fprintf(out, "\"}");
+				}
+				fprintf(out, "}");
+			}
+			if (thread.dropped > 0)
+				fprintf(out, ",\n{\"name\":\"%zu spans dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}", thread.dropped, thread.id, now() / 1000.0);
+		}
+		fprintf(out, "\n]}\n");
+		return fclose(out) == 0;
+	}
+};
+
+//Times the enclosing scope. The name, category and detail must outlive the span.
+class TraceSpan {
+	const char* category;
+	const char* name;
+	const char* detail;
+	int64_t start;
+public:
+	TraceSpan(const char* _category, const char* _name, const char* _detail = NULL) {
+		category = _category;
+		name = _name;
+		detail = _detail;
+		start = Tracer::isEnabled() ? Tracer::instance().now() : -1;
+	}
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+	~TraceSpan() {
+		if (start >= 0)
+			Tracer::instance().record(category, name, start, Tracer::instance().now(), detail);
+	}
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#if TRACE_ENABLED
+#define TRACE_SCOPE(category, ...) TraceSpan TRACE_CONCAT(traceSpan, __COUNTER__)(category, __VA_ARGS__)
+#else
+#define TRACE_SCOPE(category, ...) do {} while (0)
+#endif
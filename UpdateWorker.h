@@ -0,0 +1,98 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "CommandList.h"
+#include "Trace.h"
+
+//Runs scene updates and draw recording on a thread of its own, one frame ahead
+//of the GL thread. There are two command lists: while the GL thread replays one,
+//the worker records the next into the other, so update and submission costs
+//overlap instead of adding up. Handing a list over wakes the other side at once
+//rather than on a polling tick, since it happens every frame.
+class UpdateWorker {
+public:
+	typedef void (*RecordFunction)(CommandList& list);
+private:
+	CommandList lists[2];
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable changed;
+	RecordFunction record;
+	int ready; //recorded and not yet taken by the GL thread, -1 for neither
+	int replaying; //held by the GL thread, -1 for neither
+	bool stopping;
+
+	void recordLoop() {
+		Tracer::instance().setThreadName("update");
+		int next = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return stopping || (ready < 0 && replaying != next); });
+				if (stopping)
+					return;
+			}
+			{
+				TRACE_SCOPE("update", "record frame");
+				lists[next].reset();
+				record(lists[next]);
+			}
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				ready = next;
+			}
+			changed.notify_all();
+			next ^= 1;
+		}
+	}
+public:
+	UpdateWorker() {
+		record = NULL;
+		ready = replaying = -1;
+		stopping = false;
+	}
+	UpdateWorker(const UpdateWorker&) = delete;
+	UpdateWorker& operator=(const UpdateWorker&) = delete;
+	~UpdateWorker() {
+		stop();
+	}
+	bool isRunning() {
+		return worker.joinable();
+	}
+	//From here on only _record may touch the scene, until stop() returns
+	void start(RecordFunction _record) {
+		stop();
+		record = _record;
+		ready = replaying = -1;
+		stopping = false;
+		worker = std::thread(&UpdateWorker::recordLoop, this);
+	}
+	void stop() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		changed.notify_all();
+		if (worker.joinable())
+			worker.join();
+	}
+	//GL thread: waits for the next recorded frame and holds it until release()
+	CommandList& acquire() {
+		TRACE_SCOPE("render", "wait for update");
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [&] { return ready >= 0; });
+		replaying = ready;
+		ready = -1;
+		guard.unlock();
+		changed.notify_all();
+		return lists[replaying];
+	}
+	void release() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			replaying = -1;
+		}
+		changed.notify_all();
+	}
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <glew.h>
+
+//How a shape's points are laid out in its GL buffer. Points are always kept as
+//three floats on the CPU; the compact formats are packed from them on upload.
+//The 2D formats drop z, which the shader then reads as 0. Norm16x2 maps [-1, 1]
+//onto signed 16-bit integers; Half2 keeps 11 significant bits at any scale.
+enum class VertexFormat : uint8_t { Float3, Float2, Half2, Norm16x2 };
+
+struct VertexLayout {
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	int bytes; //per point
+};
+
+inline VertexLayout getVertexLayout(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::Float2:
+		return { 2, GL_FLOAT, GL_FALSE, 8 };
+	case VertexFormat::Half2:
+		return { 2, GL_HALF_FLOAT, GL_FALSE, 4 };
+	case VertexFormat::Norm16x2:
+		return { 2, GL_SHORT, GL_TRUE, 4 };
+	default:
+		return { 3, GL_FLOAT, GL_FALSE, 12 };
+	}
+}
+
+//Points attribute 0 at the bound array buffer, read in format
+inline void setVertexAttribute(VertexFormat format) {
+	VertexLayout layout = getVertexLayout(format);
+	glVertexAttribPointer(0, layout.size, layout.type, layout.normalized, 0, 0);
+}
+
+inline const char* getVertexFormatName(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::Float2:
+		return "float2";
+	case VertexFormat::Half2:
+		return "half";
+	case VertexFormat::Norm16x2:
+		return "norm16";
+	default:
+		return "float3";
+	}
+}
+
+inline bool parseVertexFormat(const char* name, VertexFormat& format) {
+	const VertexFormat formats[] = { VertexFormat::Float3, VertexFormat::Float2, VertexFormat::Half2, VertexFormat::Norm16x2 };
+	for (int i = 0; i < 4; i++)
+		if (strcmp(name, getVertexFormatName(formats[i])) == 0) {
+			format = formats[i];
+			return true;
+		}
+	return false;
+}
+
+//The format shapes ask for when their buffer is made. A shape the format cannot
+//hold within the precision budget takes the next wider one that can.
+inline VertexFormat& preferredVertexFormat() {
+	static VertexFormat format = VertexFormat::Norm16x2;
+	return format;
+}
+
+//Largest error a packed coordinate may have, in the points' own units. The
+//default is about a quarter of a pixel when [-1, 1] spans a 1000-pixel window.
+inline float& vertexPrecisionBudget() {
+	static float budget = 1.0f / 2048;
+	return budget;
+}
+
+//Nearest half-precision float, rounding ties to even. Values past the half
+//range become infinity; the precision check keeps them from getting this far.
+inline uint16_t toHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (exponent >= 31)
+		return sign | 0x7C00;
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return sign;
+		//Subnormal: shift the mantissa, implicit bit included, into place
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1), midpoint = 1u << (shift - 1);
+		if (rest > midpoint || (rest == midpoint && (half & 1)))
+			half++;
+		return sign | (uint16_t)half;
+	}
+	uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1FFF;
+	//A carry out of the mantissa correctly bumps the exponent, up to infinity.
+	//Branch-free, since which way a coordinate rounds is a coin toss.
+	half += (rest > 0x1000) | ((rest == 0x1000) & half);
+	return sign | (uint16_t)half;
+}
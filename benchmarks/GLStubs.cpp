@@ -0,0 +1,37 @@
+#include <glew.h>
+
+// The benchmarks never create a GL context. Shapes still release their
+// buffers on destruction, so the GLEW entry points they reach are bound to
+// no-ops here instead of linking against GLEW and a driver.
+
+static void GLAPIENTRY stubDeleteBuffers(GLsizei, const GLuint*) {}
+static void GLAPIENTRY stubBindBuffer(GLenum, GLuint) {}
+static void GLAPIENTRY stubBufferData(GLenum, GLsizeiptr, const void*, GLenum) {}
+
+PFNGLDELETEBUFFERSPROC __glewDeleteBuffers = stubDeleteBuffers;
+PFNGLBINDBUFFERPROC __glewBindBuffer = stubBindBuffer;
+PFNGLBUFFERDATAPROC __glewBufferData = stubBufferData;
+
+// Shader building is linked in through the scene file loader and the draw
+// calls but never runs, since benchmark scenes have no shaders assigned.
+PFNGLCREATESHADERPROC __glewCreateShader = NULL;
+PFNGLSHADERSOURCEPROC __glewShaderSource = NULL;
+PFNGLCOMPILESHADERPROC __glewCompileShader = NULL;
+PFNGLGETSHADERIVPROC __glewGetShaderiv = NULL;
+PFNGLGETSHADERINFOLOGPROC __glewGetShaderInfoLog = NULL;
+PFNGLCREATEPROGRAMPROC __glewCreateProgram = NULL;
+PFNGLATTACHSHADERPROC __glewAttachShader = NULL;
+PFNGLLINKPROGRAMPROC __glewLinkProgram = NULL;
+PFNGLGETPROGRAMIVPROC __glewGetProgramiv = NULL;
+PFNGLGETPROGRAMINFOLOGPROC __glewGetProgramInfoLog = NULL;
+PFNGLDETACHSHADERPROC __glewDetachShader = NULL;
+PFNGLDELETESHADERPROC __glewDeleteShader = NULL;
+PFNGLDELETEPROGRAMPROC __glewDeleteProgram = NULL;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC __glewMaxShaderCompilerThreadsKHR = NULL;
+GLboolean __GLEW_KHR_parallel_shader_compile = GL_FALSE;
+PFNGLPROGRAMBINARYPROC __glewProgramBinary = NULL;
+PFNGLGETPROGRAMBINARYPROC __glewGetProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC __glewProgramParameteri = NULL;
+GLboolean __GLEW_ARB_get_program_binary = GL_FALSE;
+const GLubyte* GLAPIENTRY glGetString(GLenum) { return NULL; }
+void GLAPIENTRY glGetIntegerv(GLenum, GLint*) {}
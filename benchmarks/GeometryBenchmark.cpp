@@ -0,0 +1,468 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include "Shader.h"
+#include "Shape.h"
+#include "SceneGenerator.h"
+#include "JobSystem.h"
+#include "SceneFile.h"
+#include "Polygon.h"
+#include "Stroke.h"
+
+// Baseline measurements for the CPU-side geometry and math kernels in Shape.h.
+// Run with --benchmark_filter=<regex> to select a single kernel.
+
+static void BM_GetRotationResult(benchmark::State& state) {
+	const int count = state.range(0);
+	std::vector<Vertex> points(count);
+	for (int i = 0; i < count; i++)
+		points[i] = Vertex(cos(i * 0.1f), sin(i * 0.1f), 0);
+	Vertex pivot(0.1f, 0.2f, 0), axis(0, 0, 1);
+	for (auto _ : state) {
+		for (int i = 0; i < count; i++)
+			points[i] = getRotationResult(pivot, axis, 1.0f * DEG_TO_RAD, points[i]);
+		benchmark::DoNotOptimize(points.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_GetRotationResult)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+static void BM_VertexNormalize(benchmark::State& state) {
+	const int count = state.range(0);
+	std::vector<Vertex> source(count), points(count);
+	for (int i = 0; i < count; i++)
+		source[i] = Vertex(i + 1.0f, i * 0.5f, 2.0f);
+	for (auto _ : state) {
+		for (int i = 0; i < count; i++) {
+			points[i] = source[i];
+			points[i].normalize();
+		}
+		benchmark::DoNotOptimize(points.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_VertexNormalize)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+static void BM_CircleGenerate(benchmark::State& state) {
+	const int segments = state.range(0);
+	Circle circle(0.1f, 0.2f, 0, segments, 0.5f, 1);
+	for (auto _ : state) {
+		circle.Generate();
+		benchmark::DoNotOptimize(circle.getPoints());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * segments);
+}
+BENCHMARK(BM_CircleGenerate)->RangeMultiplier(4)->Range(16, 4096);
+
+//Rotating a flat circle about z, which takes the 2D affine path, and about a
+//tilted axis, which still needs the full 3D rotation
+static void BM_ShapeRotate(benchmark::State& state) {
+	const bool flat = state.range(0) == 0;
+	Circle circle(0.1f, 0.2f, 0, 4096, 0.5f, 1);
+	Vertex pivot(0.1f, 0.2f, 0), axis = flat ? Vertex(0, 0, 1) : Vertex(0.6f, 0, 0.8f);
+	for (auto _ : state) {
+		circle.rotate(pivot, axis, 1.0f);
+		benchmark::DoNotOptimize(circle.getPoints());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * circle.getPointSize());
+	state.SetLabel(flat ? "about z" : "tilted axis");
+}
+BENCHMARK(BM_ShapeRotate)->DenseRange(0, 1);
+
+static void BM_OvaloidGenerate(benchmark::State& state) {
+	const int segments = state.range(0), smoothing = state.range(1);
+	Ovaloid ovaloid(0, 0, 0, segments, Vertex(0.3f, 0.2f), 1.0f, smoothing);
+	for (auto _ : state) {
+		ovaloid.generate();
+		benchmark::DoNotOptimize(ovaloid.getPoints());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * segments * smoothing);
+}
+BENCHMARK(BM_OvaloidGenerate)->ArgsProduct({ { 10, 50, 200 }, { 5, 20, 80 } });
+
+static void BM_VaseGenerate(benchmark::State& state) {
+	const int segments = state.range(0), smoothing = state.range(1), controlCount = state.range(2);
+	std::vector<Vertex> control(controlCount);
+	for (int i = 0; i < controlCount; i++)
+		control[i] = Vertex(0.1f + 0.2f * (i % 2), -0.5f + i / (float)controlCount, 0);
+	Vase vase(control.data(), controlCount, 0, 0, 0, segments, 1.0f, smoothing);
+	for (auto _ : state) {
+		vase.generate();
+		benchmark::DoNotOptimize(vase.getPoints());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * segments * smoothing);
+}
+BENCHMARK(BM_VaseGenerate)->ArgsProduct({ { 10, 50, 200 }, { 5, 20, 80 }, { 3, 6, 12 } });
+
+static void BM_GetPascal(benchmark::State& state) {
+	const int row = state.range(0);
+	for (auto _ : state) {
+		for (int col = 0; col <= row; col++)
+			benchmark::DoNotOptimize(getPascal(row, col));
+	}
+	state.SetItemsProcessed(state.iterations() * (row + 1));
+}
+BENCHMARK(BM_GetPascal)->DenseRange(4, 20, 4);
+
+static void BM_TooClose(benchmark::State& state) {
+	const int count = state.range(0);
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	std::vector<Shape*> dots(count);
+	for (int i = 0; i < count; i++)
+		dots[i] = new Circle(coordinate(random), coordinate(random), 0, 1, 0.005f, 1);
+	// A query outside [-1, 1] never matches, so every call scans all dots.
+	for (auto _ : state)
+		benchmark::DoNotOptimize(tooClose(dots, 2.0f, 2.0f));
+	state.SetItemsProcessed(state.iterations() * count);
+	for (int i = 0; i < count; i++)
+		delete dots[i];
+}
+BENCHMARK(BM_TooClose)->RangeMultiplier(10)->Range(1000, 1000000);
+
+static void BM_SceneGenerate(benchmark::State& state) {
+	const int count = state.range(0);
+	for (auto _ : state) {
+		Scene scene;
+		SceneGenerator generator;
+		generator.generate(scene, count);
+		benchmark::DoNotOptimize(scene.getVertexCount());
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SceneGenerate)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+
+//The same scene built with 0 to 7 job workers besides the calling thread
+static void BM_SceneGenerateWorkers(benchmark::State& state) {
+	int previous = JobSystem::instance().getThreadCount() - 1;
+	JobSystem::instance().setWorkerCount(state.range(0));
+	Scene scene;
+	for (auto _ : state) {
+		scene.clear();
+		SceneGenerator generator;
+		generator.generate(scene, 100000);
+		benchmark::DoNotOptimize(scene.getVertexCount());
+	}
+	JobSystem::instance().setWorkerCount(previous);
+	state.SetItemsProcessed(state.iterations() * 100000);
+}
+BENCHMARK(BM_SceneGenerateWorkers)->DenseRange(0, 7)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+//Refilling a cleared scene reuses its arena instead of allocating again
+static void BM_SceneRegenerate(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	for (auto _ : state) {
+		scene.clear();
+		SceneGenerator generator;
+		generator.generate(scene, count);
+		benchmark::DoNotOptimize(scene.getVertexCount());
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SceneRegenerate)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+
+//Maps a saved scene and rebuilds its shapes, which is all a load does before upload
+static void BM_SceneFileLoad(benchmark::State& state) {
+	const int count = state.range(0);
+	const char* path = "scene_file_benchmark.bin";
+	{
+		Scene source;
+		SceneGenerator generator;
+		generator.generate(source, count);
+		SceneFile::write(path, source);
+	}
+	Scene scene;
+	for (auto _ : state) {
+		scene.clear();
+		SceneFile file;
+		file.open(path);
+		for (int i = 0; i < file.getShapeCount(); i++)
+			file.loadShape(scene, i);
+		benchmark::DoNotOptimize(scene.getVertexCount());
+	}
+	remove(path);
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SceneFileLoad)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+
+//Gathers every shape's bounds and tests them against a view covering a quarter of the scene
+static void BM_SceneCull(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	SceneGenerator generator;
+	generator.generate(scene, count);
+	scene.setView(Bounds(Vertex(-1, -1, -1), Vertex(0, 0, 1)));
+	for (auto _ : state) {
+		scene.cull();
+		benchmark::DoNotOptimize(scene.getDrawnCount());
+	}
+	state.counters["drawn"] = scene.getDrawnCount();
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SceneCull)->RangeMultiplier(10)->Range(1000, 100000);
+
+static void BM_BvhBuild(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	SceneGenerator generator;
+	generator.generate(scene, count);
+	BoundsList bounds;
+	for (int i = 0; i < scene.getShapeCount(); i++)
+		bounds.add(scene.getShape(i)->getBounds());
+	Bvh bvh;
+	for (auto _ : state) {
+		bvh.build(bounds);
+		benchmark::DoNotOptimize(bvh.getNodeCount());
+	}
+	state.counters["depth"] = bvh.getDepth();
+	state.SetItemsProcessed(state.iterations() * bounds.size());
+}
+BENCHMARK(BM_BvhBuild)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+
+//Horizontal and vertical rays across the scene, the axis-parallel case of the slab
+//test, checked first against a scan of every box
+static void BM_BvhQueryRayAxis(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	SceneGenerator generator;
+	generator.generate(scene, count);
+	BoundsList bounds;
+	for (int i = 0; i < scene.getShapeCount(); i++)
+		bounds.add(scene.getShape(i)->getBounds());
+	Bvh bvh;
+	bvh.build(bounds);
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	std::vector<int> found;
+	for (int ray = 0; ray < 64; ray++) {
+		bool vertical = ray % 2 == 1;
+		//Every other ray runs exactly along an edge of some box
+		Bounds edge = bounds.get(ray * 7 % bounds.size());
+		float across = ray % 4 < 2 ? coordinate(random) : vertical ? edge.lower.x : edge.upper.y;
+		Vertex origin = vertical ? Vertex(across, -1) : Vertex(-1, across);
+		found.clear();
+		bvh.queryRay(origin, vertical ? Vertex(0, 1) : Vertex(1, 0), 2, found);
+		size_t expected = 0;
+		for (int i = 0; i < bounds.size(); i++) {
+			Bounds box = bounds.get(i);
+			float lower = vertical ? box.lower.x : box.lower.y, upper = vertical ? box.upper.x : box.upper.y;
+			float start = vertical ? box.lower.y : box.lower.x, end = vertical ? box.upper.y : box.upper.x;
+			if (across >= lower && across <= upper && end >= -1 && start <= 1)
+				expected++;
+		}
+		if (found.size() != expected) {
+			state.SkipWithError("axis-parallel ray missed boxes");
+			return;
+		}
+	}
+	int ray = 0;
+	for (auto _ : state) {
+		found.clear();
+		float across = coordinate(random);
+		if (ray++ % 2 == 0)
+			bvh.queryRay(Vertex(-1, across), Vertex(1, 0), 2, found);
+		else
+			bvh.queryRay(Vertex(across, -1), Vertex(0, 1), 2, found);
+		benchmark::DoNotOptimize(found.data());
+	}
+}
+BENCHMARK(BM_BvhQueryRayAxis)->RangeMultiplier(10)->Range(1000, 100000);
+
+static void BM_SceneFindAt(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	SceneGenerator generator;
+	generator.generate(scene, count);
+	scene.updateIndex();
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	std::vector<SceneItem> found;
+	for (auto _ : state) {
+		found.clear();
+		scene.findAt(coordinate(random), coordinate(random), found);
+		benchmark::DoNotOptimize(found.data());
+	}
+}
+BENCHMARK(BM_SceneFindAt)->RangeMultiplier(10)->Range(1000, 100000);
+
+//Topmost shape under a random point: hierarchy query, then exact triangle tests
+static void BM_ScenePick(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	SceneGenerator generator;
+	generator.generate(scene, count);
+	scene.updateIndex();
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	SceneItem picked;
+	for (auto _ : state)
+		benchmark::DoNotOptimize(scene.pick(coordinate(random), coordinate(random), picked));
+}
+BENCHMARK(BM_ScenePick)->RangeMultiplier(10)->Range(1000, 100000);
+
+static void BM_TrianglesContain(benchmark::State& state) {
+	const int segments = state.range(0);
+	Circle circle(0, 0, 0, segments, 0.5f, 1);
+	// A point just outside the rim misses every triangle, so all of them are tested
+	for (auto _ : state)
+		benchmark::DoNotOptimize(trianglesContain(circle.getPoints(), NULL, circle.getPointSize(), 0.5f, 0.01f));
+	state.SetItemsProcessed(state.iterations() * segments);
+}
+BENCHMARK(BM_TrianglesContain)->RangeMultiplier(4)->Range(16, 4096);
+
+//Moves one shape in a hundred and brings the hierarchy back up to date
+static void BM_SceneRefit(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	SceneGenerator generator;
+	generator.generate(scene, count);
+	scene.updateIndex();
+	float step = 0.001f;
+	for (auto _ : state) {
+		for (int i = 0; i < scene.getShapeCount(); i += 100)
+			scene.getShape(i)->translate(Vertex(step, 0));
+		step = -step;
+		scene.updateIndex();
+	}
+	state.SetItemsProcessed(state.iterations() * (scene.getShapeCount() / 100));
+}
+BENCHMARK(BM_SceneRefit)->RangeMultiplier(10)->Range(1000, 100000);
+
+//What the update thread does each frame with --threaded: cull and write every draw into a command list
+static void BM_SceneRecord(benchmark::State& state) {
+	const int count = state.range(0);
+	Scene scene;
+	SceneGenerator generator;
+	generator.generate(scene, count);
+	CommandList list;
+	for (auto _ : state) {
+		list.reset();
+		scene.record(list);
+		benchmark::DoNotOptimize(list.getCommandCount());
+	}
+	state.counters["commands"] = list.getCommandCount();
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SceneRecord)->RangeMultiplier(10)->Range(1000, 100000);
+
+//Packing a 100k-point 2D shape for upload in each VertexFormat, Float3 being a plain copy
+static void BM_VertexPack(benchmark::State& state) {
+	const VertexFormat format = (VertexFormat)state.range(0);
+	const int count = 100000;
+	std::vector<Vertex> points(count);
+	for (int i = 0; i < count; i++)
+		points[i] = Vertex(cos(i * 0.1f) * 0.9f, sin(i * 0.1f) * 0.9f, 0);
+	std::vector<unsigned char> packed(count * getVertexLayout(format).bytes);
+	for (auto _ : state) {
+		packVertices(format, points.data(), count, packed.data());
+		benchmark::DoNotOptimize(packed.data());
+	}
+	state.SetBytesProcessed(state.iterations() * packed.size());
+	state.SetLabel(getVertexFormatName(format));
+}
+BENCHMARK(BM_VertexPack)->DenseRange(0, 3);
+
+static void BM_StrokeTessellate(benchmark::State& state) {
+	const int count = state.range(0);
+	for (auto _ : state) {
+		Stroke stroke(0.01f);
+		for (int i = 0; i < count; i++)
+			stroke.addPoint(i * 0.004f, (i % 8) * 0.003f);
+		stroke.finish();
+		benchmark::DoNotOptimize(stroke.getPoints());
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_StrokeTessellate)->RangeMultiplier(10)->Range(10, 100000);
+
+//A coastline-like outline: a circle with a ragged edge, so most vertices are reflex
+static void BM_PolygonTriangulate(benchmark::State& state) {
+	const int count = state.range(0);
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> noise(0.9f, 1.1f);
+	std::vector<Vertex> outline(count);
+	for (int i = 0; i < count; i++) {
+		float angle = 2 * 3.14159265f * i / count, radius = noise(random);
+		outline[i] = Vertex(radius * cos(angle), radius * sin(angle), 0);
+	}
+	for (auto _ : state) {
+		Polygon polygon(outline.data(), count);
+		benchmark::DoNotOptimize(polygon.getTriangleCount());
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_PolygonTriangulate)->RangeMultiplier(10)->Range(100, 100000)->Unit(benchmark::kMillisecond);
+
+//A square with a grid of square holes, count of them
+static void BM_PolygonTriangulateHoles(benchmark::State& state) {
+	const int side = state.range(0), count = side * side;
+	std::vector<Vertex> points;
+	std::vector<int> rings(1, 4);
+	points.push_back(Vertex(0, 0, 0));
+	points.push_back(Vertex(1, 0, 0));
+	points.push_back(Vertex(1, 1, 0));
+	points.push_back(Vertex(0, 1, 0));
+	float cell = 1.0f / side;
+	for (int y = 0; y < side; y++)
+		for (int x = 0; x < side; x++) {
+			float left = (x + 0.25f) * cell, bottom = (y + 0.25f) * cell, size = cell / 2;
+			points.push_back(Vertex(left, bottom, 0));
+			points.push_back(Vertex(left, bottom + size, 0));
+			points.push_back(Vertex(left + size, bottom + size, 0));
+			points.push_back(Vertex(left + size, bottom, 0));
+			rings.push_back(4);
+		}
+	for (auto _ : state) {
+		Polygon polygon(points.data(), rings.data(), rings.size());
+		benchmark::DoNotOptimize(polygon.getTriangleCount());
+	}
+	state.SetItemsProcessed(state.iterations() * (count + 1) * 4);
+}
+BENCHMARK(BM_PolygonTriangulateHoles)->RangeMultiplier(4)->Range(4, 256)->Unit(benchmark::kMillisecond);
+
+//The same ragged outline moving every frame, filled through the stencil instead:
+//the per-frame cost is rewriting the points and copying them out for upload.
+//Benchmark shapes have no GL buffer, so the upload is recorded by hand.
+static void BM_StencilPolygonReshape(benchmark::State& state) {
+	const int count = state.range(0);
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> noise(0.9f, 1.1f);
+	std::vector<Vertex> outline(count);
+	for (int i = 0; i < count; i++) {
+		float angle = 2 * 3.14159265f * i / count, radius = noise(random);
+		outline[i] = Vertex(radius * cos(angle), radius * sin(angle), 0);
+	}
+	StencilPolygon polygon(outline.data(), count);
+	CommandList list;
+	int frame = 0;
+	for (auto _ : state) {
+		Vertex shift(0.001f * (frame++ & 15), 0, 0);
+		for (int i = 0; i < count; i++)
+			outline[i] = outline[i] + shift;
+		polygon.reshape(outline.data(), count);
+		list.reset();
+		list.upload(0, 0, 0, polygon.getPoints(), (count + COVER_POINTS) * sizeof(Vertex), true);
+		polygon.recordPolygon(list);
+		benchmark::DoNotOptimize(list.getPayloadBytes());
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_StencilPolygonReshape)->RangeMultiplier(10)->Range(100, 100000)->Unit(benchmark::kMillisecond);
+
+static void BM_LogDisabled(benchmark::State& state) {
+	Logger::setLevel(LogCategory::Input, LogLevel::Info);
+	double x = 0.25, y = -0.5;
+	for (auto _ : state) {
+		LOG_TRACE(LogCategory::Input, "X : %f, Y : %f", x, y);
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK(BM_LogDisabled);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,38 @@
+# Regenerates ShaderSources.h from every shaders/**/*.shader file:
+#
+#   cmake -P tools/EmbedShaders.cmake
+#
+# Run by the SimplePolygon pre-build step and the benchmark build. The header
+# is only rewritten when a shader changed, so it does not force a rebuild.
+
+get_filename_component(ROOT "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+set(TARGET "${ROOT}/ShaderSources.h")
+
+file(GLOB_RECURSE SHADERS RELATIVE "${ROOT}" "${ROOT}/shaders/*.shader")
+list(SORT SHADERS)
+
+set(OUT "#pragma once\n")
+string(APPEND OUT "// Generated by tools/EmbedShaders.cmake from shaders/. Do not edit.\n\n")
+string(APPEND OUT "struct EmbeddedShader {\n\tconst char* path;\n\tconst char* source;\n};\n\n")
+string(APPEND OUT "constexpr EmbeddedShader EMBEDDED_SHADERS[] = {\n")
+set(COUNT 0)
+foreach(SHADER ${SHADERS})
+	file(READ "${ROOT}/${SHADER}" SOURCE)
+	string(FIND "${SOURCE}" ")shader\"" CLASH)
+	if(NOT CLASH EQUAL -1)
+		message(FATAL_ERROR "${SHADER} contains )shader\" and cannot be embedded as a raw string")
+	endif()
+	string(APPEND OUT "\t{ \"${SHADER}\", R\"shader(${SOURCE})shader\" },\n")
+	math(EXPR COUNT "${COUNT} + 1")
+endforeach()
+string(APPEND OUT "};\n\n")
+string(APPEND OUT "constexpr int EMBEDDED_SHADER_COUNT = ${COUNT};\n")
+
+if(EXISTS "${TARGET}")
+	file(READ "${TARGET}" CURRENT)
+	if(CURRENT STREQUAL OUT)
+		return()
+	endif()
+endif()
+file(WRITE "${TARGET}" "${OUT}")
+message(STATUS "Embedded ${COUNT} shaders into ShaderSources.h")